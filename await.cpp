@@ -0,0 +1,166 @@
+// self
+#include "await.h"
+
+// project
+#include "../logger/logger.h"
+
+
+
+IPCReadAwaiter::IPCReadAwaiter(IPCReactor &reactor, IPC &ipc)
+	: m_reactor(reactor)
+	, m_ipc(ipc)
+	, m_pState(std::make_shared<IPCAwaitState>())
+{
+	m_pState->resumed = false;
+	m_pState->subscription = 0;
+	m_pState->failed = false;
+}
+
+
+bool IPCReadAwaiter::await_ready()
+{
+	return m_ipc.IsCanceling() || m_ipc.IsReadable();
+}
+
+
+bool IPCReadAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+	IPC &ipc = m_ipc;
+	return IPCAsync::Suspend(m_reactor, ipc, m_pState, [&ipc]() { return ipc.IsReadable(); }, handle);
+}
+
+
+IPCReadAwaiter::Result IPCReadAwaiter::await_resume()
+{
+	IPCReadAwaiter::Result result = { false, QByteArray(), 0, false, IPC::ReadError::NoError };
+
+	if (m_pState->failed) {
+		result.error = IPC::ReadError::Stopped;
+		return result;
+	}
+
+	if (m_ipc.IsCanceling()) {
+		result.error = IPC::ReadError::Canceling;
+		return result;
+	}
+
+	// 已确认可读；待读消息可能在确认之后刚好过期被丢弃，不等待，避免阻塞事件循环
+	if (m_ipc.ReadControl(result.message, result.error)) {
+		result.status = true;
+		result.control = true;
+		return result;
+	}
+
+	result.status = m_ipc.ReadMessage(result.message, result.stream, QDeadlineTimer(0), result.error);
+
+	return result;
+}
+
+
+IPCWriteAwaiter::IPCWriteAwaiter(IPCReactor &reactor, IPC &ipc, const QVector<IPC::Buffer> &buffers)
+	: m_reactor(reactor)
+	, m_ipc(ipc)
+	, m_pState(std::make_shared<IPCAwaitState>())
+{
+	m_pState->resumed = false;
+	m_pState->subscription = 0;
+	m_pState->failed = false;
+	m_pState->buffers = buffers;
+}
+
+
+bool IPCWriteAwaiter::await_ready()
+{
+	return m_ipc.IsCanceling() || m_ipc.IsPeerQuit() || m_ipc.IsWritable(m_pState->buffers);
+}
+
+
+bool IPCWriteAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+	// 只按分段大小判断空间，不访问分段内容，协程已恢复时判断也是安全的
+	IPC &ipc = m_ipc;
+	std::shared_ptr<IPCAwaitState> pState = m_pState;
+	return IPCAsync::Suspend(m_reactor, ipc, pState, [&ipc, pState]() { return ipc.IsPeerQuit() || ipc.IsWritable(pState->buffers); }, handle);
+}
+
+
+IPCWriteAwaiter::Result IPCWriteAwaiter::await_resume()
+{
+	IPCWriteAwaiter::Result result = { false, IPC::WriteError::NoError };
+
+	if (m_pState->failed) {
+		result.error = IPC::WriteError::Stopped;
+		return result;
+	}
+
+	// 空间已确认足够，读取端下线时立即返回NoReader，以下写入不会阻塞
+	result.status = m_ipc.Write(m_pState->buffers, result.error);
+
+	return result;
+}
+
+
+IPCReadAwaiter IPCAsync::Read(IPCReactor &reactor, IPC &ipc)
+{
+	return IPCReadAwaiter(reactor, ipc);
+}
+
+
+IPCWriteAwaiter IPCAsync::Write(IPCReactor &reactor, IPC &ipc, const QVector<IPC::Buffer> &buffers)
+{
+	return IPCWriteAwaiter(reactor, ipc, buffers);
+}
+
+
+bool IPCAsync::Suspend(IPCReactor &reactor, IPC &ipc, const std::shared_ptr<IPCAwaitState> &pState,
+	const std::function<bool()> &ready, std::coroutine_handle<> handle)
+{
+	// 唤醒、取消和挂起后的复查可能同时发生，只有第一个把resumed置位的恢复协程
+	IPCCancelToken token = ipc.CancelToken();
+	std::function<void()> resume = [&reactor, &ipc, pState, token, handle]() mutable {
+		if (pState->resumed.exchange(true)) {
+			return;
+		}
+
+		reactor.Remove(ipc);
+		token.Unsubscribe(pState->subscription);
+		handle.resume();
+	};
+
+	// 已取消则不挂起，还没有注册任何回调，不存在竞争
+	// Cancel可能在任意线程调用，注销通道和恢复协程都投递到事件循环线程执行
+	pState->subscription = token.Subscribe([&reactor, resume]() {
+		reactor.Post(resume);
+	});
+	if (pState->subscription == 0) {
+		pState->resumed = true;
+		return false;
+	}
+
+	// 注册后如果已经可读会立即回调，协程可能在Add返回前就恢复了，之后不能再访问等待者
+	bool added = reactor.Add(ipc, [resume, ready](IPC &ipc) mutable {
+		if (ready()) {
+			resume();
+		}
+	});
+
+	if (!added) {
+		if (pState->resumed.exchange(true)) {
+			return true;
+		}
+
+		token.Unsubscribe(pState->subscription);
+		pState->failed = true;
+
+		return false;
+	}
+
+	// 登记等待之前对端可能已经提交或释放，复查一次，避免错过唤醒
+	if (ready() && !pState->resumed.exchange(true)) {
+		reactor.Remove(ipc);
+		token.Unsubscribe(pState->subscription);
+		return false;
+	}
+
+	return true;
+}
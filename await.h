@@ -0,0 +1,127 @@
+#pragma once
+
+// project
+#include "ipc.h"
+#include "reactor.h"
+
+// c/c++
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <memory>
+
+
+
+// 协程读写，仅单块布局有效
+// 数据或空间不足时协程挂起，由事件循环在对端提交或释放时恢复，不占用线程；通道取消时以Canceling恢复
+// 协程总在事件循环线程中恢复执行，取消时的恢复也投递到事件循环线程
+// 挂起期间通道注册在事件循环上，同一通道同时只能有一个等待者，也不能再用IPCDispatcher::Attach；否则以Stopped返回
+//
+//     IPCTask Consume(IPCReactor &reactor, IPC &ipc)
+//     {
+//         while (true) {
+//             IPCReadAwaiter::Result result = co_await IPCAsync::Read(reactor, ipc);
+//             if (!result.status) {
+//                 break;
+//             }
+//             ...
+//         }
+//     }
+
+
+// 不等待结果的协程，立即开始执行，结束时自动销毁
+class IPCTask
+{
+public:
+    struct promise_type
+    {
+        IPCTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+
+// 挂起期间的共享状态，协程恢复后等待者可能已经销毁，回调只访问这里
+struct IPCAwaitState
+{
+    // 是否已恢复，恢复只发生一次
+    std::atomic<bool> resumed;
+    // 取消订阅编号
+    quint64 subscription;
+    // 挂起失败
+    bool failed;
+    // 写入时的分段，仅用于判断空间是否足够
+    QVector<IPC::Buffer> buffers;
+};
+
+
+// 读取一条完整的消息，控制消息优先
+class IPCReadAwaiter
+{
+public:
+    struct Result
+    {
+        bool status;
+        // 消息，格式同数据通道：消息头大小 + 消息头 + 扩展头 + 消息体
+        QByteArray message;
+        // 流编号，控制消息为0
+        quint64 stream;
+        // 是否来自控制通道
+        bool control;
+        // 待读消息在恢复前过期被丢弃时为Timeout，可以再次co_await
+        IPC::ReadError error;
+    };
+
+    IPCReadAwaiter(IPCReactor &reactor, IPC &ipc);
+
+    bool await_ready();
+    bool await_suspend(std::coroutine_handle<> handle);
+    IPCReadAwaiter::Result await_resume();
+
+
+private:
+    IPCReactor &m_reactor;
+    IPC &m_ipc;
+    std::shared_ptr<IPCAwaitState> m_pState;
+};
+
+
+// 写入一条消息，所有分段一次提交；分段内容在恢复之前须保持有效
+class IPCWriteAwaiter
+{
+public:
+    struct Result
+    {
+        bool status;
+        IPC::WriteError error;
+    };
+
+    IPCWriteAwaiter(IPCReactor &reactor, IPC &ipc, const QVector<IPC::Buffer> &buffers);
+
+    bool await_ready();
+    bool await_suspend(std::coroutine_handle<> handle);
+    IPCWriteAwaiter::Result await_resume();
+
+
+private:
+    IPCReactor &m_reactor;
+    IPC &m_ipc;
+    std::shared_ptr<IPCAwaitState> m_pState;
+};
+
+
+class IPCAsync
+{
+public:
+    // co_await IPCAsync::Read(reactor, ipc)
+    static IPCReadAwaiter Read(IPCReactor &reactor, IPC &ipc);
+    // co_await IPCAsync::Write(reactor, ipc, buffers)
+    static IPCWriteAwaiter Write(IPCReactor &reactor, IPC &ipc, const QVector<IPC::Buffer> &buffers);
+
+    // 在事件循环上挂起，ready在对端唤醒时判断是否可以恢复；返回false表示不需要挂起
+    static bool Suspend(IPCReactor &reactor, IPC &ipc, const std::shared_ptr<IPCAwaitState> &pState,
+        const std::function<bool()> &ready, std::coroutine_handle<> handle);
+};
@@ -0,0 +1,64 @@
+// self
+#include "cancel.h"
+
+
+
+IPCCancelToken::IPCCancelToken()
+	: m_pState(std::make_shared<State>())
+{
+	m_pState->canceled = false;
+	m_pState->nextId = 1;
+}
+
+
+void IPCCancelToken::Cancel()
+{
+	QHash<quint64, Callback> callbacks;
+	{
+		std::lock_guard<std::mutex> locker(m_pState->mutex);
+		if (m_pState->canceled.exchange(true)) {
+			return;
+		}
+
+		callbacks.swap(m_pState->callbacks);
+	}
+
+	// 回调不持锁执行，回调里可以再订阅或取消订阅
+	for (quint64 id : callbacks.keys()) {
+		callbacks.value(id)();
+	}
+}
+
+
+bool IPCCancelToken::IsCanceled() const
+{
+	return m_pState->canceled.load();
+}
+
+
+void IPCCancelToken::Reset()
+{
+	std::lock_guard<std::mutex> locker(m_pState->mutex);
+	m_pState->canceled = false;
+}
+
+
+quint64 IPCCancelToken::Subscribe(const Callback &callback)
+{
+	std::lock_guard<std::mutex> locker(m_pState->mutex);
+	if (m_pState->canceled.load()) {
+		return 0;
+	}
+
+	quint64 id = m_pState->nextId++;
+	m_pState->callbacks.insert(id, callback);
+
+	return id;
+}
+
+
+void IPCCancelToken::Unsubscribe(quint64 id)
+{
+	std::lock_guard<std::mutex> locker(m_pState->mutex);
+	m_pState->callbacks.remove(id);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+// qt
+#include <QtCore/QHash>
+
+// c/c++
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+
+
+// 取消令牌，拷贝后共享同一个状态
+// 取消时依次执行已订阅的回调，用于唤醒正在等待的线程或挂起的协程
+class IPCCancelToken
+{
+public:
+    using Callback = std::function<void()>;
+
+    IPCCancelToken();
+
+    // 取消，执行并清空全部订阅；可在任意线程调用
+    void Cancel();
+    // 是否已取消
+    bool IsCanceled() const;
+    // 清除取消状态，重新开始时调用
+    void Reset();
+
+    // 订阅取消，返回订阅编号；已取消时不订阅，返回0
+    quint64 Subscribe(const Callback &callback);
+    // 取消订阅
+    void Unsubscribe(quint64 id);
+
+
+private:
+    struct State
+    {
+        std::atomic<bool> canceled;
+        std::mutex mutex;
+        QHash<quint64, Callback> callbacks;
+        quint64 nextId;
+    };
+
+    std::shared_ptr<State> m_pState;
+};
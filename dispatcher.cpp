@@ -0,0 +1,301 @@
+// self
+#include "dispatcher.h"
+
+// project
+#include "../logger/logger.h"
+
+// qt
+#include <QtCore/QThread>
+
+
+
+// 当前线程所属的线程池和序号，不是工作线程时为空
+static thread_local IPCDispatcher *sCurrentDispatcher = nullptr;
+static thread_local qint32 sCurrentWorker = -1;
+
+
+IPCDispatcher::IPCDispatcher(qint32 threads)
+	: m_ThreadCount(threads > 0 ? threads : qMax(QThread::idealThreadCount(), 1))
+	, m_NextGeneration(1)
+	, m_pending(0)
+	, m_NextWorker(0)
+	, m_isRunning(false)
+{
+	for (qint32 i = 0; i < m_ThreadCount; i++) {
+		m_Workers.push_back(std::make_unique<Worker>());
+		m_Workers.back()->executed = 0;
+		m_Workers.back()->steals = 0;
+	}
+}
+
+
+IPCDispatcher::~IPCDispatcher()
+{
+	Stop();
+}
+
+
+void IPCDispatcher::Start()
+{
+	if (m_isRunning.exchange(true)) {
+		return;
+	}
+
+	for (qint32 i = 0; i < m_ThreadCount; i++) {
+		m_Workers[i]->thread = std::thread(&IPCDispatcher::Run, this, i);
+	}
+}
+
+
+void IPCDispatcher::Stop()
+{
+	if (!m_isRunning.exchange(false)) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> locker(m_IdleMutex);
+	}
+	m_Idle.notify_all();
+
+	for (std::unique_ptr<Worker> &pWorker : m_Workers) {
+		if (pWorker->thread.joinable()) {
+			pWorker->thread.join();
+		}
+
+		pWorker->tasks.clear();
+	}
+
+	std::lock_guard<std::mutex> locker(m_Mutex);
+	m_Strands.clear();
+	m_pending = 0;
+}
+
+
+void IPCDispatcher::SetHandler(quint64 channel, const Handler &handler)
+{
+	std::lock_guard<std::mutex> locker(m_Mutex);
+
+	if (!m_Strands.contains(channel)) {
+		m_Strands.insert(channel, { handler, {}, false, m_NextGeneration++ });
+	}
+	else {
+		m_Strands[channel].handler = handler;
+	}
+}
+
+
+void IPCDispatcher::RemoveChannel(quint64 channel)
+{
+	std::lock_guard<std::mutex> locker(m_Mutex);
+
+	// 已排队或正在执行的任务找不到通道或序号不同，直接停止
+	m_Strands.remove(channel);
+}
+
+
+bool IPCDispatcher::Post(quint64 channel, QByteArray message, quint64 stream)
+{
+	Task task = { channel, 0 };
+	{
+		std::lock_guard<std::mutex> locker(m_Mutex);
+
+		if (!m_isRunning || !m_Strands.contains(channel)) {
+			return false;
+		}
+
+		Strand &strand = m_Strands[channel];
+		strand.messages.enqueue({ stream, std::move(message) });
+
+		// 通道已在排队或执行中，执行完会继续处理新消息，保证同一通道串行
+		if (strand.scheduled) {
+			return true;
+		}
+
+		strand.scheduled = true;
+		task.generation = strand.generation;
+	}
+
+	Schedule(task);
+
+	return true;
+}
+
+
+bool IPCDispatcher::Attach(IPCReactor &reactor, IPC &ipc, quint64 channel)
+{
+	return reactor.Add(ipc, [this, channel](IPC &ipc) {
+		// 控制消息优先投递，之后读空数据通道；都在同一个通道里，处理顺序与读取顺序一致
+		// 在事件循环线程里读，不等待：可读之后消息仍可能过期被丢弃，读不到就是读空了
+		IPC::ReadError error = IPC::ReadError::NoError;
+		while (ipc.IsReadable()) {
+			QByteArray message;
+			quint64 stream = 0;
+			if (!ipc.ReadControl(message, error) && !ipc.ReadMessage(message, stream, QDeadlineTimer(0), error)) {
+				if (error != IPC::ReadError::ControlPending) {
+					break;
+				}
+
+				continue;
+			}
+
+			Post(channel, std::move(message), stream);
+		}
+	});
+}
+
+
+qsizetype IPCDispatcher::Depth(quint64 channel)
+{
+	std::lock_guard<std::mutex> locker(m_Mutex);
+	return m_Strands.contains(channel) ? m_Strands[channel].messages.size() : 0;
+}
+
+
+QVector<IPCDispatcher::WorkerStats> IPCDispatcher::Stats()
+{
+	QVector<IPCDispatcher::WorkerStats> stats;
+	for (std::unique_ptr<Worker> &pWorker : m_Workers) {
+		std::lock_guard<std::mutex> locker(pWorker->mutex);
+		stats.append({ (qsizetype)pWorker->tasks.size(), pWorker->executed.load(), pWorker->steals.load() });
+	}
+
+	return stats;
+}
+
+
+quint64 IPCDispatcher::Steals()
+{
+	quint64 steals = 0;
+	for (std::unique_ptr<Worker> &pWorker : m_Workers) {
+		steals += pWorker->steals.load();
+	}
+
+	return steals;
+}
+
+
+void IPCDispatcher::Run(qint32 index)
+{
+	sCurrentDispatcher = this;
+	sCurrentWorker = index;
+
+	Task task = { 0, 0 };
+	while (m_isRunning) {
+		if (Pop(index, task)) {
+			Execute(index, task);
+			continue;
+		}
+
+		// 先看计数再睡，投递时先加计数再唤醒，不会错过
+		std::unique_lock<std::mutex> locker(m_IdleMutex);
+		m_Idle.wait(locker, [this]() { return !m_isRunning || m_pending.load() > 0; });
+	}
+
+	sCurrentDispatcher = nullptr;
+	sCurrentWorker = -1;
+}
+
+
+bool IPCDispatcher::Pop(qint32 index, IPCDispatcher::Task &task)
+{
+	// 本地队列从尾部取，刚放进去的通道数据还在缓存里
+	{
+		Worker &self = *m_Workers[index];
+		std::lock_guard<std::mutex> locker(self.mutex);
+		if (!self.tasks.empty()) {
+			task = self.tasks.back();
+			self.tasks.pop_back();
+			m_pending--;
+			return true;
+		}
+	}
+
+	// 从下一个线程开始依次窃取，从头部取最早排队的通道
+	for (qint32 i = 1; i < m_ThreadCount; i++) {
+		Worker &victim = *m_Workers[(index + i) % m_ThreadCount];
+		std::lock_guard<std::mutex> locker(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = victim.tasks.front();
+			victim.tasks.pop_front();
+			m_pending--;
+			m_Workers[index]->steals++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+void IPCDispatcher::Execute(qint32 index, const IPCDispatcher::Task &task)
+{
+	quint64 channel = task.channel;
+	for (qint32 i = 0; i < BatchSize; i++) {
+		Message message;
+		Handler handler;
+		{
+			std::lock_guard<std::mutex> locker(m_Mutex);
+			// 通道被移除后又重新设置，新的串行队列由它自己的任务执行，这里不能碰
+			if (!m_Strands.contains(channel) || m_Strands[channel].generation != task.generation) {
+				return;
+			}
+
+			Strand &strand = m_Strands[channel];
+			if (strand.messages.isEmpty()) {
+				strand.scheduled = false;
+				return;
+			}
+
+			message = strand.messages.dequeue();
+			handler = strand.handler;
+		}
+
+		// 处理函数不持锁执行
+		if (handler) {
+			handler(channel, message.stream, message.data);
+		}
+
+		m_Workers[index]->executed++;
+	}
+
+	// 一批处理完还有消息，重新排到队尾，让其它通道有机会执行
+	bool more = false;
+	{
+		std::lock_guard<std::mutex> locker(m_Mutex);
+		if (m_Strands.contains(channel) && m_Strands[channel].generation == task.generation) {
+			Strand &strand = m_Strands[channel];
+			more = !strand.messages.isEmpty();
+			strand.scheduled = more;
+		}
+	}
+
+	if (more) {
+		Schedule(task);
+	}
+}
+
+
+void IPCDispatcher::Schedule(const IPCDispatcher::Task &task)
+{
+	qint32 index = sCurrentDispatcher == this ? sCurrentWorker : (qint32)(m_NextWorker++ % m_ThreadCount);
+
+	{
+		Worker &worker = *m_Workers[index];
+		std::lock_guard<std::mutex> locker(worker.mutex);
+		// 重新排队的通道放在头部，本线程先处理新到的通道，其它线程窃取时先拿到它
+		if (sCurrentDispatcher == this) {
+			worker.tasks.push_front(task);
+		}
+		else {
+			worker.tasks.push_back(task);
+		}
+	}
+
+	m_pending++;
+
+	{
+		std::lock_guard<std::mutex> locker(m_IdleMutex);
+	}
+	m_Idle.notify_one();
+}
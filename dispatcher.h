@@ -0,0 +1,134 @@
+#pragma once
+
+// project
+#include "ipc.h"
+#include "reactor.h"
+
+// qt
+#include <QtCore/QHash>
+#include <QtCore/QQueue>
+
+// c/c++
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+
+// 读取端消息处理线程池，按通道串行、跨通道并行
+// 每个通道是一个串行队列(strand)，同一时刻至多在一个工作线程上执行；工作线程优先处理自己的任务，空闲时从其它线程窃取
+class IPCDispatcher
+{
+public:
+    // 消息处理函数，在工作线程中执行；stream为消息所属的流编号(未复用时即写入端的序号)，控制消息为0
+    using Handler = std::function<void(quint64 channel, quint64 stream, const QByteArray &message)>;
+
+    // 工作线程统计
+    struct WorkerStats
+    {
+        // 本地队列中待执行的通道数
+        qsizetype depth;
+        // 已执行的消息数
+        quint64 executed;
+        // 从其它线程窃取的次数
+        quint64 steals;
+    };
+
+    // 一个通道一次最多连续处理的消息数，处理完重新排队，避免一个繁忙通道霸占工作线程
+    static const qint32 BatchSize = 16;
+
+    // threads <= 0 时使用CPU核数
+    explicit IPCDispatcher(qint32 threads = 0);
+    ~IPCDispatcher();
+
+    // 启动工作线程
+    void Start();
+    // 停止工作线程，未处理的消息丢弃
+    void Stop();
+
+    // 设置通道的处理函数
+    void SetHandler(quint64 channel, const Handler &handler);
+    // 移除通道，未处理的消息丢弃；正在执行的一批处理完当前消息后停止，之后重新设置的同名通道是新的串行队列
+    void RemoveChannel(quint64 channel);
+    // 投递一条消息，不阻塞
+    bool Post(quint64 channel, QByteArray message, quint64 stream = 0);
+
+    // 把读取端注册到事件循环，可读时读出全部消息投递到channel，须先设置channel的处理函数
+    bool Attach(IPCReactor &reactor, IPC &ipc, quint64 channel);
+
+    // 通道中待处理的消息数
+    qsizetype Depth(quint64 channel);
+    // 各工作线程的统计
+    QVector<IPCDispatcher::WorkerStats> Stats();
+    // 累计窃取次数
+    quint64 Steals();
+
+
+private:
+    // 待处理的消息及其流编号
+    struct Message
+    {
+        quint64 stream;
+        QByteArray data;
+    };
+
+    // 通道的串行队列
+    struct Strand
+    {
+        Handler handler;
+        QQueue<Message> messages;
+        // 是否已在某个工作线程的队列中或正在执行
+        bool scheduled;
+        // 创建序号，移除后重新设置的同名通道序号不同，旧的任务据此停止
+        quint64 generation;
+    };
+
+    // 排队的任务：通道及创建序号
+    struct Task
+    {
+        quint64 channel;
+        quint64 generation;
+    };
+
+    // 工作线程
+    struct Worker
+    {
+        std::mutex mutex;
+        // 待执行的通道，本线程从尾部取，其它线程从头部窃取
+        std::deque<Task> tasks;
+        std::atomic<quint64> executed;
+        std::atomic<quint64> steals;
+        std::thread thread;
+    };
+
+    // 工作线程主循环
+    void Run(qint32 index);
+    // 取一个待执行的通道，先取本地，再窃取
+    bool Pop(qint32 index, IPCDispatcher::Task &task);
+    // 执行一个通道的一批消息，通道已被移除或替换时停止
+    void Execute(qint32 index, const IPCDispatcher::Task &task);
+    // 把通道放入工作线程队列，工作线程内放入自己的队列，其它线程轮流分配
+    void Schedule(const IPCDispatcher::Task &task);
+
+    qint32 m_ThreadCount;
+    std::vector<std::unique_ptr<Worker>> m_Workers;
+
+    std::mutex m_Mutex;
+    QHash<quint64, Strand> m_Strands;
+    // 下一个通道创建序号
+    quint64 m_NextGeneration;
+
+    // 空闲的工作线程在这里等待
+    std::mutex m_IdleMutex;
+    std::condition_variable m_Idle;
+    // 已排队但未取走的通道数
+    std::atomic<qint64> m_pending;
+
+    std::atomic<quint32> m_NextWorker;
+    std::atomic<bool> m_isRunning;
+};
@@ -0,0 +1,117 @@
+// self
+#include "extradata.h"
+
+// qt
+#include <QtCore/QThread>
+
+// c/c++
+#include <cstring>
+#include <new>
+
+
+
+IPCExtradata::IPCExtradata()
+	: m_pHeader(nullptr)
+{
+}
+
+
+qsizetype IPCExtradata::Bytes()
+{
+	return (sizeof(Header) + 63) & ~63;
+}
+
+
+void IPCExtradata::Format(void *address)
+{
+	m_pHeader = new (address) Header();
+	m_pHeader->sequence.store(0, std::memory_order_relaxed);
+	m_pHeader->codec = 0;
+	m_pHeader->size = 0;
+}
+
+
+void IPCExtradata::Attach(void *address)
+{
+	m_pHeader = (Header *)address;
+}
+
+
+void IPCExtradata::Resume(void *address)
+{
+	m_pHeader = (Header *)address;
+
+	quint64 sequence = m_pHeader->sequence.load(std::memory_order_relaxed);
+	if (sequence & 1) {
+		m_pHeader->sequence.store(sequence + 1, std::memory_order_release);
+	}
+}
+
+
+void IPCExtradata::Detach()
+{
+	m_pHeader = nullptr;
+}
+
+
+bool IPCExtradata::IsAttached()
+{
+	return m_pHeader != nullptr;
+}
+
+
+bool IPCExtradata::Publish(qint32 codec, const char *pData, qsizetype nbytes)
+{
+	if (nbytes < 0 || nbytes > Capacity) {
+		return false;
+	}
+
+	// 只有写入端修改，直接和当前内容比较；每个I帧都带参数集时大多数调用到这里就返回
+	quint64 sequence = m_pHeader->sequence.load(std::memory_order_relaxed);
+	if (sequence != 0 && m_pHeader->codec == codec && m_pHeader->size == (quint32)nbytes && memcmp(m_pHeader->data, pData, nbytes) == 0) {
+		return false;
+	}
+
+	m_pHeader->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	m_pHeader->codec = codec;
+	m_pHeader->size = (quint32)nbytes;
+	memcpy(m_pHeader->data, pData, nbytes);
+
+	m_pHeader->sequence.store(sequence + 2, std::memory_order_release);
+
+	return true;
+}
+
+
+quint64 IPCExtradata::Version()
+{
+	return m_pHeader->sequence.load(std::memory_order_acquire) / 2;
+}
+
+
+quint64 IPCExtradata::Fetch(qint32 &codec, QByteArray &extradata)
+{
+	for (qint32 retry = 0; retry < MaxRetries; retry++) {
+		quint64 begin = m_pHeader->sequence.load(std::memory_order_acquire);
+		if (begin & 1) {
+			QThread::yieldCurrentThread();
+			continue;
+		}
+
+		// 拷贝期间可能被改写，大小先限定在容量内，序号不一致就重读
+		qint32 type = m_pHeader->codec;
+		quint32 size = qMin<quint32>(m_pHeader->size, Capacity);
+		QByteArray data(m_pHeader->data, size);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (m_pHeader->sequence.load(std::memory_order_relaxed) == begin) {
+			codec = type;
+			extradata = data;
+			return begin / 2;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+// qt
+#include <QtCore/QByteArray>
+
+// c/c++
+#include <atomic>
+
+
+
+// 位于共享内存中的解码器配置(SPS/PPS/VPS等extradata)，只保留当前的一份
+// 与参数块一样用顺序锁发布：写入端改写前后各把序号加一，读取端拷贝前后序号相同且为偶数才算完整
+// 版本即已发布的次数，读取端上线或发现版本变化时取一次，可以在等待第一帧的同时初始化解码器
+class IPCExtradata
+{
+public:
+    // 读取端拷贝的最多尝试次数，每次失败让出一次时间片；写入端在发布中途退出时序号停在奇数，不能一直等
+    static const qint32 MaxRetries = 1000;
+
+    // 配置的最大字节数，参数集通常只有几十到几百字节
+    static const qsizetype Capacity = 4096;
+
+    // 共享内存中的布局
+    struct Header
+    {
+        // 顺序锁序号，只由写入端修改
+        alignas(64) std::atomic<quint64> sequence;
+        // 编码类型，取值同VideoHead::Codec
+        qint32 codec;
+        // 配置大小
+        quint32 size;
+        // 配置内容
+        char data[Capacity];
+    };
+
+
+public:
+    IPCExtradata();
+
+    // 需要的共享内存字节数
+    static qsizetype Bytes();
+
+    // 写入端创建共享内存后初始化
+    void Format(void *address);
+    // 读取端挂载共享内存后映射
+    void Attach(void *address);
+    // 常驻通道的写入端接管：上一个写入端可能在发布中途退出，把序号补成偶数
+    void Resume(void *address);
+    // 解除映射
+    void Detach();
+    // 是否已映射
+    bool IsAttached();
+
+    // 写入端：发布配置，与当前内容相同时不发布，返回是否产生了新版本；调用方保证同一时刻只有一个线程发布
+    bool Publish(qint32 codec, const char *pData, qsizetype nbytes);
+    // 当前版本，0表示还没有发布过
+    quint64 Version();
+    // 读取端：取一份完整的配置，返回对应的版本；重试MaxRetries次仍取不到完整内容时返回0，调用方改用码流中的参数集
+    quint64 Fetch(qint32 &codec, QByteArray &extradata);
+
+
+private:
+    // 共享内存中的配置
+    Header *m_pHeader;
+};
@@ -10,12 +10,19 @@
 #endif
 
 // qt
+#include <QtCore/QDeadlineTimer>
 #include <QtCore/QThread>
+#include <QtCore/QVarLengthArray>
+
+// c/c++
+#include <limits>
+#include <new>
 
 
 
 IPC::IPC()
 	: m_Type(IPC::Type::None)
+	, m_Layout(IPC::Layout::Triple)
 	, m_IsSharedMemory1Locked(false)
 	, m_IsSharedMemory2Locked(false)
 	, m_IsSharedMemory3Locked(false)
@@ -23,12 +30,35 @@ IPC::IPC()
 	, m_pSharedMemory1(nullptr)
 	, m_pSharedMemory2(nullptr)
 	, m_pSharedMemory3(nullptr)
+	, m_pSharedMemory0(nullptr)
+	, m_pControl(nullptr)
+	, m_ParameterGeneration(0)
+	, m_ExtradataVersion(0)
+	, m_pWriterNotifier(nullptr)
+	, m_pReaderNotifier(nullptr)
+	, m_MemoryKey0("")
 	, m_MemoryKey1("")
 	, m_MemoryKey2("")
 	, m_MemoryKey3("")
 	, m_MaxBytes(0)
-	, m_isCanceling(false)
 	, m_index(0)
+	, m_isPersistent(false)
+	, m_Generation(0)
+	, m_Backpressure(IPC::Backpressure::Block)
+	, m_isWaitingKeyframe(false)
+	, m_droppedFrames(0)
+	, m_decimationCount(0)
+	, m_filteredMessages(0)
+	, m_isWatching(false)
+	, m_CombineBytes(0)
+	, m_CombineBudget(0)
+	, m_GopBytes(0)
+	, m_GopCachedBytes(0)
+	, m_isGopValid(false)
+	, m_ReaderEpoch(0)
+	, m_isGopStartPending(false)
+	, m_isJoining(false)
+	, m_TimeToLive(0)
 {
 }
 
@@ -44,25 +74,58 @@ IPC::~IPC()
 }
 
 
-bool IPC::StartWriter(QString key, qsizetype maxBytes, quint64 index)
+bool IPC::StartWriter(QString key, qsizetype maxBytes, quint64 index, IPC::Layout layout)
 {
+	m_MemoryKey0 = QString("%1_%2_0").arg(SharedMemoryKeyPrefix).arg(key);
 	m_MemoryKey1 = QString("%1_%2_1").arg(SharedMemoryKeyPrefix).arg(key);
 	m_MemoryKey2 = QString("%1_%2_2").arg(SharedMemoryKeyPrefix).arg(key);
 	m_MemoryKey3 = QString("%1_%2_3").arg(SharedMemoryKeyPrefix).arg(key);
 	m_MaxBytes = maxBytes + 1;
 	m_index = index;
+	m_Layout = layout;
+
+	// 三块布局判断不了整条消息能否写完，开启前设置的丢帧策略退回阻塞
+	if (m_Layout == IPC::Layout::Triple && m_Backpressure == IPC::Backpressure::DropToKeyframe) {
+		LogWarning() << QString("drop to keyframe not supported by triple layout, fall back to block, key: %1\n").arg(key);
+		m_Backpressure = IPC::Backpressure::Block;
+	}
+
+	bool status = false;
+	if (m_Layout != IPC::Layout::Triple) {
+		if (m_Layout == IPC::Layout::Single && m_index > IPCRing::MaxStream) {
+			LogWarning() << QString("stream index out of range, key: %1, index: %2\n").arg(key).arg(m_index);
+		}
 
-	bool status = StartWriteShare(m_pSharedMemory1, m_MemoryKey1);
-	status = StartWriteShare(m_pSharedMemory2, m_MemoryKey2);
-	status = StartWriteShare(m_pSharedMemory3, m_MemoryKey3);
+		// 常驻通道优先接管仍然存在的共享内存，接管不了再新建
+		if (m_isPersistent && ResumeSingleShare()) {
+			status = true;
+		}
+		else {
+			status = StartWriteShare(m_pSharedMemory0, m_MemoryKey0);
+			if (status) {
+				FormatSingleShare();
+			}
+		}
+	}
+	else {
+		status = StartWriteShare(m_pSharedMemory1, m_MemoryKey1);
+		status = StartWriteShare(m_pSharedMemory2, m_MemoryKey2);
+		status = StartWriteShare(m_pSharedMemory3, m_MemoryKey3);
 
-	memset(m_pSharedMemory3->data(), 0, 1 + sizeof(qint64) * 2);
+		memset(m_pSharedMemory3->data(), 0, 1 + sizeof(qint64) * 2);
 
-	m_pSharedMemory = m_pSharedMemory1;
+		m_pSharedMemory = m_pSharedMemory1;
+	}
 
 	m_Type = IPC::Type::Writer;
 
-	m_isCanceling = false;
+	m_CancelToken.Reset();
+
+	StartNotifier(m_pWriterNotifier, QString("%1_%2_writer").arg(SharedMemoryKeyPrefix).arg(key));
+	StartNotifier(m_pReaderNotifier, QString("%1_%2_reader").arg(SharedMemoryKeyPrefix).arg(key));
+
+	// 共享内存已全部创建，唤醒正在等待的读取端
+	m_pReaderNotifier->Notify();
 
 	return status;
 }
@@ -70,36 +133,81 @@ bool IPC::StartWriter(QString key, qsizetype maxBytes, quint64 index)
 
 bool IPC::StopWriter()
 {
-	m_Type = IPC::Type::None;
-	m_isCanceling = true;
+	// 先取消，让阻塞在本通道上的读写和事件循环回调尽快返回，注销时要等回调结束
+	m_CancelToken.Cancel();
+	emit Stopping();
+	Watch(false);
+
+	// 定时提交只尝试加锁，等正在执行的一次结束不会死锁；之后不会再有定时提交与清理并发
+	TaskPool::GetInstance()->RemoveIntervalTask("FlushCombined", true);
+	{
+		std::lock_guard<std::mutex> locker(m_WriteMutex);
+
+		// 已合并的消息尽量提交，读取端不在时放弃
+		if (!IsNullPtr(m_pControl)) {
+			IPC::WriteError error;
+			FlushCombined(QDeadlineTimer(0), error);
+		}
+		m_CombineBuffer.clear();
+		m_CombineBytes = 0;
+		m_Gop.clear();
+		m_GopCachedBytes = 0;
+		m_isGopValid = false;
+		m_Pacer.Reset();
+
+		m_Type = IPC::Type::None;
+
+		m_pControl = nullptr;
+		m_Ring.Detach();
+		m_ReverseRing.Detach();
+		m_Parameters.Detach();
+		m_Extradata.Detach();
+		m_Mailbox.Detach();
+	}
 
-	bool status = StopAllShare(m_pSharedMemory1);
+	bool status = StopAllShare(m_pSharedMemory0);
+	status = StopAllShare(m_pSharedMemory1);
 	status = StopAllShare(m_pSharedMemory2);
 	status = StopAllShare(m_pSharedMemory3);
 
+	// 写入端创建了通道，终止时删除命名管道；常驻通道的读取端还在用，保留
+	StopNotifier(m_pWriterNotifier, !m_isPersistent);
+	StopNotifier(m_pReaderNotifier, !m_isPersistent);
+
 	TaskPool::GetInstance()->RemoveIntervalTask("KeepWriterAlive", false);
 
 	return status;
 }
 
 
-bool IPC::StartReader(QString key, qsizetype maxBytes, quint64 index)
+bool IPC::StartReader(QString key, qsizetype maxBytes, quint64 index, IPC::Layout layout)
 {
+	m_MemoryKey0 = QString("%1_%2_0").arg(SharedMemoryKeyPrefix).arg(key);
 	m_MemoryKey1 = QString("%1_%2_1").arg(SharedMemoryKeyPrefix).arg(key);
 	m_MemoryKey2 = QString("%1_%2_2").arg(SharedMemoryKeyPrefix).arg(key);
 	m_MemoryKey3 = QString("%1_%2_3").arg(SharedMemoryKeyPrefix).arg(key);
 	m_MaxBytes = maxBytes + 1;
 	m_index = index;
+	m_Layout = layout;
 
-	bool status = StartReadShare(m_pSharedMemory1, m_MemoryKey1);
-	status = StartReadShare(m_pSharedMemory2, m_MemoryKey2);
-	status = StartReadShare(m_pSharedMemory3, m_MemoryKey3);
+	bool status = false;
+	if (m_Layout != IPC::Layout::Triple) {
+		status = StartReadShare(m_pSharedMemory0, m_MemoryKey0) && MapSingleShare();
+	}
+	else {
+		status = StartReadShare(m_pSharedMemory1, m_MemoryKey1);
+		status = StartReadShare(m_pSharedMemory2, m_MemoryKey2);
+		status = StartReadShare(m_pSharedMemory3, m_MemoryKey3);
 
-	m_pSharedMemory = m_pSharedMemory1;
+		m_pSharedMemory = m_pSharedMemory1;
+	}
 
 	m_Type = IPC::Type::Reader;
 
-	m_isCanceling = false;
+	m_CancelToken.Reset();
+
+	StartNotifier(m_pWriterNotifier, QString("%1_%2_writer").arg(SharedMemoryKeyPrefix).arg(key));
+	StartNotifier(m_pReaderNotifier, QString("%1_%2_reader").arg(SharedMemoryKeyPrefix).arg(key));
 
 	return status;
 }
@@ -107,13 +215,35 @@ bool IPC::StartReader(QString key, qsizetype maxBytes, quint64 index)
 
 bool IPC::StopReader()
 {
+	// 先取消，让阻塞在本通道上的读取和事件循环回调尽快返回，注销时要等回调结束
+	m_CancelToken.Cancel();
+	emit Stopping();
+	Watch(false);
+
+	// 订阅条件和额度窗口只属于本读取端，下一个读取端默认接收全部消息、不限额度
+	if (!IsNullPtr(m_pControl)) {
+		Subscribe({ 0, 0, 0 });
+		SetCreditWindow(0, 0);
+	}
+
 	m_Type = IPC::Type::None;
-	m_isCanceling = true;
 
-	bool status = StopAllShare(m_pSharedMemory1);
+	m_pControl = nullptr;
+	m_isJoining = false;
+	m_Ring.Detach();
+	m_ReverseRing.Detach();
+	m_Parameters.Detach();
+	m_Extradata.Detach();
+	m_Mailbox.Detach();
+
+	bool status = StopAllShare(m_pSharedMemory0);
+	status = StopAllShare(m_pSharedMemory1);
 	status = StopAllShare(m_pSharedMemory2);
 	status = StopAllShare(m_pSharedMemory3);
 
+	StopNotifier(m_pWriterNotifier);
+	StopNotifier(m_pReaderNotifier);
+
 	TaskPool::GetInstance()->RemoveIntervalTask("KeepReaderAlive", false);
 
 	return status;
@@ -122,337 +252,2310 @@ bool IPC::StopReader()
 
 void IPC::Cancel()
 {
-	m_isCanceling = true;
+	m_CancelToken.Cancel();
+
+	// 打断正在等待对端上线的线程
+	if (!IsNullPtr(m_pWriterNotifier)) {
+		m_pWriterNotifier->Interrupt();
+	}
+	if (!IsNullPtr(m_pReaderNotifier)) {
+		m_pReaderNotifier->Interrupt();
+	}
 }
 
 
 bool IPC::IsCanceling()
 {
-	return m_isCanceling;
+	return m_CancelToken.IsCanceled();
 }
 
 
-bool IPC::WaitUntilWriterAttached(qint32 msTimeout, bool lock)
+IPCCancelToken IPC::CancelToken()
 {
-	qint64 ms = 0;
-	unsigned long timeout = 40;
-	while (!m_isCanceling && msTimeout > 0 && !m_pSharedMemory1->attach()) {
-		if (ms % 1000 == 0) {
-			LogInfo() << QString("milliseconds: %1\n").arg(ms);
+	return m_CancelToken;
+}
+
+
+bool IPC::IsWritable(const QVector<IPC::Buffer> &buffers)
+{
+	if (m_Type != IPC::Type::Writer || m_CancelToken.IsCanceled()) {
+		return false;
+	}
+
+	// 邮箱总能写入，旧消息直接被覆盖
+	if (m_Layout == IPC::Layout::Mailbox) {
+		return true;
+	}
+
+	if (m_Layout == IPC::Layout::Single) {
+		// 试着申请一次再退回，不会对读取端可见；申请会移动写入位置，与写入互斥
+		std::lock_guard<std::mutex> locker(m_WriteMutex);
+		QVarLengthArray<char *, 8> payloads(buffers.size());
+		if (!ClaimRecords(buffers, m_index, 0, payloads.data())) {
+			return false;
 		}
-		ms += timeout;
-		msTimeout -= timeout;
-		QThread::msleep(timeout);
+
+		m_Ring.Rollback();
+		return true;
+	}
+
+	// 双缓冲只看当前缓冲区是否已被读走
+	return GetCharType(m_pSharedMemory) == 0;
+}
+
+
+bool IPC::SetBackpressure(IPC::Backpressure policy)
+{
+	// 未开启时还不知道布局，开启写入端时再检查
+	if (policy == IPC::Backpressure::DropToKeyframe && m_Type == IPC::Type::Writer && m_Layout == IPC::Layout::Triple) {
+		LogWarning() << QString("drop to keyframe not supported by triple layout, key: %1\n").arg(m_MemoryKey0);
+		return false;
+	}
+
+	m_Backpressure = policy;
+	m_isWaitingKeyframe = false;
+
+	return true;
+}
+
+
+IPC::Backpressure IPC::GetBackpressure()
+{
+	return m_Backpressure;
+}
+
+
+IPC::Layout IPC::GetLayout()
+{
+	return m_Layout;
+}
+
+
+bool IPC::ShouldDropFrame(bool keyframe, const QVector<IPC::Buffer> &buffers)
+{
+	if (m_Backpressure != IPC::Backpressure::DropToKeyframe) {
+		return false;
 	}
 
-	ms = 0;
-	while (!m_isCanceling && msTimeout > 0 && !m_pSharedMemory2->attach()) {
-		if (ms % 1000 == 0) {
-			LogInfo() << QString("milliseconds: %1\n").arg(ms);
+	// I帧必须送达，空间不足也阻塞等待，送出后恢复正常
+	if (keyframe) {
+		if (m_isWaitingKeyframe.exchange(false)) {
+			LogInfo() << QString("resume at keyframe, dropped frames: %1\n").arg(m_droppedFrames.load());
 		}
-		ms += timeout;
-		msTimeout -= timeout;
-		QThread::msleep(timeout);
+
+		return false;
+	}
+
+	// 丢过一帧之后，后续依赖它的P/B帧都无法解码，一直丢到下一个I帧
+	if (!m_isWaitingKeyframe && IsWritable(buffers)) {
+		return false;
+	}
+
+	m_isWaitingKeyframe = true;
+	m_droppedFrames++;
+
+	// 缓存的GOP缺了这一帧，后面的帧无法解码，等下一个I帧重新缓存
+	if (m_GopBytes > 0) {
+		std::lock_guard<std::mutex> locker(m_WriteMutex);
+		m_isGopValid = false;
+	}
+
+	return true;
+}
+
+
+quint64 IPC::DroppedFrames()
+{
+	return m_droppedFrames.load();
+}
+
+
+bool IPC::Subscribe(const IPC::Subscription &subscription)
+{
+	if (m_Type != IPC::Type::Reader || IsNullPtr(m_pControl)) {
+		return false;
+	}
+
+	m_pControl->subscribedTypes.store(subscription.types);
+	m_pControl->subscribedFrameTypes.store(subscription.frameTypes);
+	m_pControl->decimation.store(subscription.decimation);
+
+	return true;
+}
+
+
+bool IPC::IsSubscribed(qint32 type, qint32 frameType)
+{
+	if (m_Type != IPC::Type::Writer || IsNullPtr(m_pControl)) {
+		return true;
+	}
+
+	// 每次发送都读一遍，读取端随时可以改订阅
+	quint32 types = m_pControl->subscribedTypes.load(std::memory_order_relaxed);
+	if (types != 0 && (type < 0 || type >= 32 || !(types & (1u << type)))) {
+		m_filteredMessages++;
+		return false;
+	}
+
+	if (frameType < 0) {
+		return true;
+	}
+
+	quint32 frameTypes = m_pControl->subscribedFrameTypes.load(std::memory_order_relaxed);
+	if (frameTypes != 0 && (frameType >= 32 || !(frameTypes & (1u << frameType)))) {
+		m_filteredMessages++;
+		return false;
+	}
+
+	// 抽帧只数符合帧类型的帧
+	quint32 decimation = m_pControl->decimation.load(std::memory_order_relaxed);
+	if (decimation > 1 && m_decimationCount++ % decimation != 0) {
+		m_filteredMessages++;
+		return false;
+	}
+
+	return true;
+}
+
+
+quint64 IPC::FilteredMessages()
+{
+	return m_filteredMessages.load();
+}
+
+
+bool IPC::SetCreditWindow(qint64 bytes, qint64 records)
+{
+	if (m_Type != IPC::Type::Reader || m_Layout != IPC::Layout::Single || IsNullPtr(m_pControl)) {
+		return false;
+	}
+
+	m_pControl->creditBytes.store(qMax<qint64>(bytes, 0));
+	m_pControl->creditRecords.store(qMax<qint64>(records, 0));
+
+	// 窗口放大后，正在等额度的写入端可以继续
+	NotifyWriter();
+
+	return true;
+}
+
+
+void IPC::SetTimeToLive(qint32 msTtl)
+{
+	m_TimeToLive = qMax(msTtl, 0);
+}
+
+
+quint64 IPC::ExpiredMessages()
+{
+	if (IsNullPtr(m_pControl) || m_Layout != IPC::Layout::Single) {
+		return 0;
+	}
+
+	return m_pControl->expiredMessages.load();
+}
+
+
+qint64 IPC::CreditBytes()
+{
+	if (m_Layout != IPC::Layout::Single || IsNullPtr(m_pControl)) {
+		return std::numeric_limits<qint64>::max();
+	}
+
+	qint64 window = m_pControl->creditBytes.load(std::memory_order_relaxed);
+
+	return window <= 0 ? std::numeric_limits<qint64>::max() : window - m_Ring.Used();
+}
+
+
+qint64 IPC::CreditRecords()
+{
+	if (m_Layout != IPC::Layout::Single || IsNullPtr(m_pControl)) {
+		return std::numeric_limits<qint64>::max();
+	}
+
+	qint64 window = m_pControl->creditRecords.load(std::memory_order_relaxed);
+
+	return window <= 0 ? std::numeric_limits<qint64>::max() : window - m_Ring.UsedRecords();
+}
+
+
+void IPC::SetPacing(qint32 msLead, quint32 ticksPerSecond)
+{
+	m_Pacer.Configure(msLead, ticksPerSecond);
+}
+
+
+void IPC::SetPacingSpeed(qint32 speed)
+{
+	m_Pacer.SetSpeed(speed);
+}
+
+
+bool IPC::PaceFrame(quint64 timestamp, IPC::WriteError &error)
+{
+	if (m_Type != IPC::Type::Writer) {
+		error = IPC::WriteError::Stopped;
+		return false;
+	}
+
+	// 取消时正在等待的帧立即返回
+	if (!m_Pacer.Wait(timestamp, m_CancelToken)) {
+		error = IPC::WriteError::Canceling;
+		return false;
+	}
+
+	error = IPC::WriteError::NoError;
+
+	return true;
+}
+
+
+void IPC::SetGopCache(qint64 maxBytes)
+{
+	std::lock_guard<std::mutex> locker(m_WriteMutex);
+
+	m_GopBytes = qMax<qint64>(maxBytes, 0);
+	m_Gop.clear();
+	m_GopCachedBytes = 0;
+	m_isGopValid = false;
+
+	// 已开启时立即告知读取端，未开启时在创建或接管共享内存时写入
+	if (m_Type == IPC::Type::Writer && !IsNullPtr(m_pControl)) {
+		m_pControl->gopCached.store(m_GopBytes > 0 ? 1 : 0);
+		m_ReaderEpoch = m_pControl->readerEpoch.load();
+	}
+}
+
+
+bool IPC::WriteFrame(bool keyframe, const QVector<IPC::Buffer> &buffers, IPC::WriteError &error)
+{
+	if (m_Layout != IPC::Layout::Single || m_GopBytes <= 0) {
+		return Write(buffers, error);
+	}
+
+	if (m_Type != IPC::Type::Writer) {
+		error = IPC::WriteError::Stopped;
+		return false;
+	}
+
+	std::lock_guard<std::mutex> locker(m_WriteMutex);
+
+	if (m_CancelToken.IsCanceled()) {
+		error = IPC::WriteError::Canceling;
+		return false;
 	}
 
-	ms = 0;
-	while (!m_isCanceling && msTimeout > 0 && !m_pSharedMemory3->attach()) {
-		if (ms % 1000 == 0) {
-			LogInfo() << QString("milliseconds: %1\n").arg(ms);
+	// 新的读取端上线，先补上最近的GOP；当前就是I帧时从这一帧开始即可
+	quint32 epoch = m_pControl->readerEpoch.load();
+	if (epoch != m_ReaderEpoch) {
+		m_ReaderEpoch = epoch;
+		m_isGopStartPending = true;
+		if (!keyframe && !ReplayGop(error)) {
+			return false;
 		}
-		ms += timeout;
-		msTimeout -= timeout;
-		QThread::msleep(timeout);
 	}
 
-	bool attached = m_pSharedMemory1->isAttached() && m_pSharedMemory2->isAttached() && m_pSharedMemory3->isAttached();
+	CacheFrame(keyframe, buffers);
+
+	return WriteGopMessage(buffers, error);
+}
+
+
+void IPC::CacheFrame(bool keyframe, const QVector<IPC::Buffer> &buffers)
+{
+	if (keyframe) {
+		m_Gop.clear();
+		m_GopCachedBytes = 0;
+		m_isGopValid = true;
+	}
+
+	// 还没见过I帧，缓存的帧无法解码，不必保留
+	if (!m_isGopValid) {
+		return;
+	}
+
+	qint64 nbytes = 0;
+	for (const IPC::Buffer &buffer : buffers) {
+		nbytes += buffer.nbytes;
+	}
+
+	// GOP超过上限就放弃这一组，等下一个I帧重新开始
+	if (m_GopCachedBytes + nbytes > m_GopBytes) {
+		LogWarning() << QString("gop exceeds cache, key: %1, bytes: %2\n").arg(m_MemoryKey0).arg(m_GopCachedBytes + nbytes);
+		m_Gop.clear();
+		m_GopCachedBytes = 0;
+		m_isGopValid = false;
+		return;
+	}
+
+	// 分段原样保留，重放时读取端仍按消息头大小、消息头、扩展头、消息体逐段读取
+	QVector<QByteArray> message;
+	for (const IPC::Buffer &buffer : buffers) {
+		message.append(QByteArray(buffer.pData, buffer.nbytes));
+	}
+
+	m_Gop.append(message);
+	m_GopCachedBytes += nbytes;
+}
+
+
+bool IPC::ReplayGop(IPC::WriteError &error)
+{
+	error = IPC::WriteError::NoError;
+	if (!m_isGopValid || m_Gop.isEmpty()) {
+		return true;
+	}
+
+	LogInfo() << QString("replay gop to new reader, key: %1, frames: %2\n").arg(m_MemoryKey0).arg(m_Gop.size());
+
+	for (const QVector<QByteArray> &message : m_Gop) {
+		QVarLengthArray<IPC::Buffer, 8> buffers;
+		for (const QByteArray &segment : message) {
+			buffers.append({ segment.constData(), segment.size() });
+		}
+
+		if (!WriteGopMessage(QVector<IPC::Buffer>(buffers.begin(), buffers.end()), error)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+bool IPC::WriteGopMessage(const QVector<IPC::Buffer> &buffers, IPC::WriteError &error)
+{
+	if (!m_isGopStartPending) {
+		return WriteMessage(buffers, m_index, QDeadlineTimer(QDeadlineTimer::Forever), error);
+	}
+
+	// 起点单独成一条记录，合并后标志会丢失；先提交已合并的消息，保证顺序
+	if (!FlushCombined(QDeadlineTimer(QDeadlineTimer::Forever), error)
+		|| !WriteRecord(buffers, m_index, IPCRing::GopStart, QDeadlineTimer(QDeadlineTimer::Forever), error)) {
+		return false;
+	}
+
+	m_isGopStartPending = false;
+
+	return true;
+}
+
+
+void IPC::JoinAtKeyframe()
+{
+	if (m_Type != IPC::Type::Reader || m_Layout != IPC::Layout::Single || IsNullPtr(m_pControl)) {
+		return;
+	}
+
+	if (m_pControl->gopCached.load() == 0) {
+		return;
+	}
+
+	// 先通知写入端重放，再丢弃旧帧：环里本流的记录在读到GopStart之前都是旧帧，由PeekRecord和Unpack逐条丢弃
+	// 不能在这里一次跳过，写入端可能在通知前后提交帧，跳过会连重放一起丢掉；其它流的记录照常读取
+	m_isJoining = true;
+	m_pControl->readerEpoch.fetch_add(1);
+
+	for (auto it = m_Unpacked.begin(); it != m_Unpacked.end();) {
+		it = it->stream == m_index ? m_Unpacked.erase(it) : it + 1;
+	}
+
+	NotifyWriter();
+}
+
+
+bool IPC::IsStaleBeforeGop(const IPCRing::Record *pRecord)
+{
+	if (!m_isJoining || (pRecord->flags & IPCRing::Combined) || IPCRing::Stream(pRecord) != (m_index & IPCRing::MaxStream)) {
+		return false;
+	}
+
+	if (pRecord->flags & IPCRing::GopStart) {
+		m_isJoining = false;
+		return false;
+	}
+
+	return true;
+}
+
+
+void IPC::SetPersistent(bool persistent)
+{
+	m_isPersistent = persistent;
+}
+
+
+quint64 IPC::Generation()
+{
+	if (IsNullPtr(m_pControl)) {
+		return 0;
+	}
+
+	return m_pControl->generation.load();
+}
+
+
+bool IPC::WaitUntilWriterAttached(qint32 msTimeout, bool lock)
+{
+	// 写入端创建完全部共享内存后会通知，这里只在被唤醒时尝试挂载，不再轮询
+	QDeadlineTimer deadline(qMax(msTimeout, 0));
+	while (!m_CancelToken.IsCanceled()) {
+		bool attached = false;
+		if (m_Layout != IPC::Layout::Triple) {
+			// 单块布局只需挂载一次，控制块校验通过才算上线
+			attached = (m_pSharedMemory0->isAttached() || m_pSharedMemory0->attach()) && MapSingleShare();
+		}
+		else {
+			attached = (m_pSharedMemory1->isAttached() || m_pSharedMemory1->attach())
+				&& (m_pSharedMemory2->isAttached() || m_pSharedMemory2->attach())
+				&& (m_pSharedMemory3->isAttached() || m_pSharedMemory3->attach());
+		}
+		if (attached || deadline.hasExpired()) {
+			break;
+		}
+
+		// 旧写入端终止时删除了管道，新写入端的通知只会发到新管道；每次最多等一个间隔，错过通知只多等一次轮询
+		m_pReaderNotifier->Refresh();
+		m_pReaderNotifier->Wait(WaitInterval(deadline));
+	}
+
+	bool attached = m_Layout != IPC::Layout::Triple
+		? !IsNullPtr(m_pControl)
+		: m_pSharedMemory1->isAttached() && m_pSharedMemory2->isAttached() && m_pSharedMemory3->isAttached();
+
+	LogInfoC(attached ? "attached\n" : "cancelled\n");
+
+	if (attached) {
+		// ÿ300һ
+		TaskPool::GetInstance()->SubmitIntervalTask(
+			"KeepReaderAlive", this, 300,
+			[](void *ptr) {
+				IPC *pThis = (IPC *)ptr;
+				pThis->KeepReaderAlive();
+				return true;
+			}
+		);
+	}
+
+	return attached;
+}
+
+
+bool IPC::WaitUntilReaderAttached(qint32 msTimeout, bool lock)
+{
+	// 读取端设置上线状态后会通知，被唤醒才重新检查
+	QDeadlineTimer deadline(qMax(msTimeout, 0));
+	while (!m_CancelToken.IsCanceled() && !deadline.hasExpired() && !IsReaderAttached(lock)) {
+		m_pWriterNotifier->Refresh();
+		m_pWriterNotifier->Wait(WaitInterval(deadline));
+	}
+
+	bool attached = IsReaderAttached(lock);
+
+	LogInfoC(attached ? "attached\n" : "cancelled\n");
+
+	if (!attached) {
+		return false;
+	}
+
+	if (attached) {
+		// ÿ300һ
+		TaskPool::GetInstance()->SubmitIntervalTask(
+			"KeepWriterAlive", this, 300,
+			[](void *ptr) {
+				IPC *pThis = (IPC *)ptr;
+				pThis->KeepWriterAlive();
+				return true;
+			}
+		);
+	}
+
+	//if (!lock) {
+	//	Lock(m_pSharedMemory1);
+	//}
+	SetCharType(m_pSharedMemory1, (char)CharType::InitForWriting, false);
+
+	//if (!lock) {
+	//	Lock(m_pSharedMemory2);
+	//}
+	SetCharType(m_pSharedMemory2, (char)CharType::InitForWriting, false);
+
+	// ڵǰʱϼһ10룬ֹʱӳ
+	KeepWriterAlive(10 * 1000);
+
+	return attached;
+}
+
+
+bool IPC::Write(QByteArray &content, IPC::WriteError &error, bool lock)
+{
+	return Write(content.constData(), content.size(), error, lock);
+}
+
+
+bool IPC::Write(const char *buffer, qint64 nbytes, IPC::WriteError &error, bool lock)
+{
+	std::lock_guard<std::mutex> locker(m_WriteMutex);
+
+	return WriteBuffer(buffer, nbytes, QDeadlineTimer(QDeadlineTimer::Forever), error, lock);
+}
+
+
+bool IPC::WriteBuffer(const char *buffer, qint64 nbytes, const QDeadlineTimer &deadline, IPC::WriteError &error, bool lock)
+{
+	if (m_Type != IPC::Type::Writer) {
+		error = IPC::WriteError::Stopped;
+		return false;
+	}
+
+	if (m_CancelToken.IsCanceled()) {
+		error = IPC::WriteError::Canceling;
+		return false;
+	}
+
+	if (m_Layout == IPC::Layout::Single) {
+		return WriteMessage({ { buffer, nbytes } }, m_index, deadline, error);
+	}
+
+	if (m_Layout == IPC::Layout::Mailbox) {
+		return WriteMailbox({ { buffer, nbytes } }, error);
+	}
+
+	errno_t err = 0;
+	char type = 0;
+	qint64 ms = 0;
+	unsigned long timeout = 4;
+	while (!m_CancelToken.IsCanceled()) {
+		if (lock && !Lock()) {
+			error = IPC::WriteError::LockFail;
+
+			if (deadline.hasExpired()) {
+				error = IPC::WriteError::Timeout;
+				return false;
+			}
+
+			InterruptibleSleep(timeout);
+			ms += timeout;
+
+			continue;
+		}
+
+		type = GetCharType(m_pSharedMemory, !lock);
+		if (type == 0) {
+			IncrCharType(m_pSharedMemory, !lock);
+
+			err = memcpy_s((char *)m_pSharedMemory->data() + 1, m_MaxBytes, buffer, nbytes);
+
+			break;
+		}
+
+		if (lock && !Unlock()) {
+			error = IPC::WriteError::UnlockFail;
+		}
+
+		// 超时时锁已释放，也没有写入，不交换缓冲区
+		if (deadline.hasExpired()) {
+			error = IPC::WriteError::Timeout;
+			return false;
+		}
+
+		if (ms > 0 && ms % 1000 == 0) {
+			LogInfo() << QString("wait space, milliseconds: %1\n").arg(ms);
+		}
+
+		InterruptibleSleep(timeout);
+		ms += timeout;
+	}
+
+	if (lock && !Unlock()) {
+		error = IPC::WriteError::UnlockFail;
+	}
+
+	if (err != 0) {
+		error = IPC::WriteError::MemcopyFail;
+		return false;
+	}
+
+	Swap();
+
+	if (m_CancelToken.IsCanceled()) {
+		error = IPC::WriteError::Canceling;
+		return false;
+	}
+
+	bool status = false;
+	if (type > 0) {
+		error = IPC::WriteError::NoSpace;
+	}
+	else if (type == 0) {
+		error = IPC::WriteError::NoError;
+		status = true;
+	}
+	else {
+		error = IPC::WriteError::NoReader;
+	}
+
+	return status;
+}
+
+
+bool IPC::Write(const QVector<IPC::Buffer> &buffers, IPC::WriteError &error, bool lock)
+{
+	return Write(buffers, QDeadlineTimer(QDeadlineTimer::Forever), error, lock);
+}
+
+
+bool IPC::Write(const QVector<IPC::Buffer> &buffers, QDeadlineTimer deadline, IPC::WriteError &error, bool lock)
+{
+	if (m_Type != IPC::Type::Writer) {
+		error = IPC::WriteError::Stopped;
+		return false;
+	}
+
+	// 一条消息的所有分段在同一把锁内写完，不会与其它线程的消息交错；锁只属于本通道，不同通道互不影响
+	std::lock_guard<std::mutex> locker(m_WriteMutex);
+
+	if (m_Layout == IPC::Layout::Single) {
+		if (m_CancelToken.IsCanceled()) {
+			error = IPC::WriteError::Canceling;
+			return false;
+		}
+
+		return WriteMessage(buffers, m_index, deadline, error);
+	}
+
+	if (m_Layout == IPC::Layout::Mailbox) {
+		if (m_CancelToken.IsCanceled()) {
+			error = IPC::WriteError::Canceling;
+			return false;
+		}
+
+		return WriteMailbox(buffers, error);
+	}
+
+	// 双缓冲只能逐段写入，读取端按分段拆帧，写了一半就返回会让之后的消息全部错位
+	// 因此截止时间只在写第一段之前有效，开始写入后等到整条消息写完
+	for (qsizetype i = 0; i < buffers.size(); i++) {
+		QDeadlineTimer segmentDeadline = i == 0 ? deadline : QDeadlineTimer(QDeadlineTimer::Forever);
+		if (!WriteBuffer(buffers[i].pData, buffers[i].nbytes, segmentDeadline, error, lock)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+bool IPC::TryWrite(const QVector<IPC::Buffer> &buffers, IPC::WriteError &error, bool lock)
+{
+	// 不等待，已超时即为空间不足
+	if (!Write(buffers, QDeadlineTimer(0), error, lock)) {
+		if (error == IPC::WriteError::Timeout) {
+			error = IPC::WriteError::NoSpace;
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+
+qint32 IPC::ReadInt32(IPC::ReadError &error, bool lock)
+{
+	qint32 nbytes = -1;
+
+	QByteArray buffer;
+	bool status = Read(buffer, sizeof(qint32), error, lock);
+	if (!status) {
+		// 控制通道有消息待处理不算失败
+		if (error != IPC::ReadError::ControlPending) {
+			LogWarning() << QString("ipc read common header size fail, nbytes: %1, error: %2\n").arg(sizeof(qint32)).arg((qint32)error);
+		}
+	}
+	else {
+		std::memcpy(&nbytes, buffer.constData(), sizeof(qint32));
+	}
+
+	return nbytes;
+}
+
+
+bool IPC::Read(QByteArray &content, qsizetype nbytes, IPC::ReadError &error, bool lock)
+{
+	return Read(content, nbytes, QDeadlineTimer(QDeadlineTimer::Forever), error, lock);
+}
+
+
+bool IPC::TryRead(QByteArray &content, qsizetype nbytes, IPC::ReadError &error, bool lock)
+{
+	// 不等待，已超时即为没有数据
+	if (!Read(content, nbytes, QDeadlineTimer(0), error, lock)) {
+		if (error == IPC::ReadError::Timeout) {
+			error = IPC::ReadError::NoData;
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+
+bool IPC::Read(QByteArray &content, qsizetype nbytes, QDeadlineTimer deadline, IPC::ReadError &error, bool lock)
+{
+	if (m_Type != IPC::Type::Reader) {
+		error = IPC::ReadError::Stopped;
+		return false;
+	}
+
+	if (m_CancelToken.IsCanceled()) {
+		error = IPC::ReadError::Canceling;
+		return false;
+	}
+
+	if (m_Layout == IPC::Layout::Single) {
+		return ReadRecord(content, nbytes, deadline, error);
+	}
+
+	if (m_Layout == IPC::Layout::Mailbox) {
+		return ReadMailbox(content, nbytes, deadline, error);
+	}
+
+	char type = 0;
+	qint64 ms = 0;
+	unsigned long timeout = 4;
+	while (!m_CancelToken.IsCanceled()) {
+		if (lock && !Lock()) {
+			error = IPC::ReadError::LockFail;
+
+			if (deadline.hasExpired()) {
+				error = IPC::ReadError::Timeout;
+				return false;
+			}
+
+			InterruptibleSleep(timeout);
+			ms += timeout;
+
+			continue;
+		}
+
+		type = GetCharType(m_pSharedMemory, !lock);
+		if (type > 0) {
+			DecrCharType(m_pSharedMemory, !lock);
+
+			content.append((const char *)m_pSharedMemory->constData() + 1, nbytes);
+
+			break;
+		}
+
+		if (lock && !Unlock()) {
+			error = IPC::ReadError::UnlockFail;
+		}
+
+		// 超时时锁已释放，也没有读取，不交换缓冲区
+		if (deadline.hasExpired()) {
+			error = IPC::ReadError::Timeout;
+			return false;
+		}
+
+		if (ms > 0 && ms % 1000 == 0) {
+			LogInfo() << QString("wait space, milliseconds: %1\n").arg(ms);
+		}
+
+		InterruptibleSleep(timeout);
+		ms += timeout;
+	}
+
+	if (lock && !Unlock()) {
+		error = IPC::ReadError::UnlockFail;
+	}
+
+	Swap();
+
+	if (m_CancelToken.IsCanceled()) {
+		error = IPC::ReadError::Canceling;
+		return false;
+	}
+
+	bool status = false;
+	if (type > 0) {
+		error = IPC::ReadError::NoError;
+		status = true;
+	}
+	else if (type == (char)IPC::CharType::Quit) {
+		error = IPC::ReadError::Quit;
+	}
+	else {
+		error = IPC::ReadError::NoData;
+	}
+
+	return status;
+}
+
+
+bool IPC::StartWriteShare(QSharedMemory *&pSharedMemory, QString &key)
+{
+	if (IsNullPtr(pSharedMemory)) {
+		pSharedMemory = new QSharedMemory();
+		pSharedMemory->setKey(key);
+
+		if (!pSharedMemory->isAttached()) {
+			pSharedMemory->detach();
+		}
+
+		if (!pSharedMemory->create(SharedMemoryBytes(pSharedMemory))) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+bool IPC::StartReadShare(QSharedMemory *&pSharedMemory, QString &key)
+{
+	if (IsNullPtr(pSharedMemory)) {
+		pSharedMemory = new QSharedMemory();
+		pSharedMemory->setKey(key);
+
+		if (!pSharedMemory->attach()) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+bool IPC::StopAllShare(QSharedMemory *&pSharedMemory)
+{
+	if (!IsNullPtr(pSharedMemory)) {
+		pSharedMemory->detach();
+		delete pSharedMemory;
+		pSharedMemory = nullptr;
+	}
+
+	return true;
+}
+
+
+qsizetype IPC::SharedMemoryBytes(QSharedMemory *&pSharedMemory)
+{
+	// 控制块 + 参数块 + 解码器配置 + 控制通道 + 反向通道 + 环形数据区，数据区能容纳两条最大记录，与双缓冲的深度一致
+	if (&pSharedMemory == &m_pSharedMemory0) {
+		// 邮箱布局：控制块 + 参数块 + 解码器配置 + 三个最大消息大小的槽
+		if (m_Layout == IPC::Layout::Mailbox) {
+			return sizeof(ControlBlock) + IPCParameterBlock::Bytes() + IPCExtradata::Bytes() + IPCMailbox::Bytes(MailboxCapacity());
+		}
+
+		return sizeof(ControlBlock) + IPCParameterBlock::Bytes() + IPCExtradata::Bytes()
+			+ IPCRing::Bytes(ControlRingCapacity) + IPCRing::Bytes(ReverseRingCapacity) + IPCRing::Bytes(RingCapacity());
+	}
+
+	// 起始字节写状态，接下来的8个字节记写入端心跳，末尾8个字节写读取端心跳
+	if (&pSharedMemory == &m_pSharedMemory3) {
+		return 1 + sizeof(qint64) * 2;
+	}
+
+	return m_MaxBytes;
+}
+
+
+void IPC::FormatSingleShare()
+{
+	char *pData = (char *)m_pSharedMemory0->data();
+
+	m_pControl = new (pData) ControlBlock();
+	m_pControl->version = ControlBlockVersion;
+	m_pControl->state.store((char)CharType::InitForWriting);
+	m_pControl->generation.store(1);
+	m_pControl->writerHeartBeat.store(0);
+	m_pControl->readerHeartBeat.store(0);
+	m_pControl->writerWaiting.store(0);
+	m_pControl->readerWaiting.store(0);
+	m_pControl->subscribedTypes.store(0);
+	m_pControl->subscribedFrameTypes.store(0);
+	m_pControl->decimation.store(0);
+	m_pControl->gopCached.store(m_GopBytes > 0 ? 1 : 0);
+	m_pControl->readerEpoch.store(0);
+	m_ReaderEpoch = 0;
+	m_pControl->creditBytes.store(0);
+	m_pControl->creditRecords.store(0);
+	m_pControl->expiredMessages.store(0);
+
+	pData += sizeof(ControlBlock);
+	m_Parameters.Format(pData);
+
+	pData += IPCParameterBlock::Bytes();
+	m_Extradata.Format(pData);
+
+	pData += IPCExtradata::Bytes();
+	if (m_Layout == IPC::Layout::Mailbox) {
+		m_Mailbox.Format(pData, MailboxCapacity());
+	}
+	else {
+		m_ControlRing.Format(pData, ControlRingCapacity);
+
+		pData += IPCRing::Bytes(ControlRingCapacity);
+		m_ReverseRing.Format(pData, ReverseRingCapacity);
+
+		pData += IPCRing::Bytes(ReverseRingCapacity);
+		m_Ring.Format(pData, RingCapacity());
+	}
+
+	// 最后写魔数，读取端看到魔数时控制块和数据区都已初始化完毕
+	m_pControl->magic.store(ControlMagic(), std::memory_order_release);
+}
+
+
+bool IPC::MapSingleShare()
+{
+	if (!IsNullPtr(m_pControl)) {
+		return true;
+	}
+
+	char *pData = (char *)m_pSharedMemory0->data();
+
+	ControlBlock *pControl = (ControlBlock *)pData;
+	if (pControl->magic.load(std::memory_order_acquire) != ControlMagic() || pControl->version != ControlBlockVersion) {
+		LogWarning() << QString("control block mismatch, key: %1\n").arg(m_MemoryKey0);
+		return false;
+	}
+
+	m_pControl = pControl;
+
+	pData += sizeof(ControlBlock);
+	m_Parameters.Attach(pData);
+	m_ParameterGeneration = 0;
+
+	pData += IPCParameterBlock::Bytes();
+	m_Extradata.Attach(pData);
+	m_ExtradataVersion = 0;
+
+	pData += IPCExtradata::Bytes();
+	if (m_Layout == IPC::Layout::Mailbox) {
+		m_Mailbox.Attach(pData);
+	}
+	else {
+		m_ControlRing.Attach(pData);
+
+		pData += IPCRing::Bytes(ControlRingCapacity);
+		m_ReverseRing.Attach(pData);
+
+		pData += IPCRing::Bytes(ReverseRingCapacity);
+		m_Ring.Attach(pData);
+	}
+
+	m_Generation = m_pControl->generation.load();
+
+	return true;
+}
+
+
+bool IPC::ResumeSingleShare()
+{
+	// 邮箱的槽没有已提交位置可以接着写，直接重新创建
+	if (m_Layout != IPC::Layout::Single) {
+		return false;
+	}
+
+	if (IsNullPtr(m_pSharedMemory0)) {
+		m_pSharedMemory0 = new QSharedMemory();
+		m_pSharedMemory0->setKey(m_MemoryKey0);
+	}
+
+	// 读取端还挂着，共享内存就还在；控制块不对则放弃接管，重新创建
+	if (!m_pSharedMemory0->attach() || !MapSingleShare()) {
+		StopAllShare(m_pSharedMemory0);
+		return false;
+	}
+
+	// 上一个写入端的maxBytes更小，大帧永远写不进去；让读取端退出，放弃接管
+	if (m_pSharedMemory0->size() < SharedMemoryBytes(m_pSharedMemory0) || m_Ring.Capacity() < RingCapacity()) {
+		LogWarning() << QString("persistent channel too small, key: %1, capacity: %2, need: %3\n").arg(m_MemoryKey0).arg(m_Ring.Capacity()).arg(RingCapacity());
+		// 通知对象还没打开，读取端最迟在下一次等待超时时看到退出
+		m_pControl->state.store((char)CharType::Quit);
+		m_pControl = nullptr;
+		m_Ring.Detach();
+		m_ControlRing.Detach();
+		m_ReverseRing.Detach();
+		m_Parameters.Detach();
+		m_Extradata.Detach();
+		StopAllShare(m_pSharedMemory0);
+		return false;
+	}
+
+	// 上一个写入端退出或异常时留下的状态作废，读取端仍在线则保留
+	if (m_pControl->state.load() != (char)CharType::ReaderAttach) {
+		m_pControl->state.store((char)CharType::InitForWriting);
+	}
+
+	// 已提交的记录和参数原样保留，从已提交位置继续写
+	m_Parameters.Resume((char *)m_pControl + sizeof(ControlBlock));
+	m_Extradata.Resume((char *)m_pControl + sizeof(ControlBlock) + IPCParameterBlock::Bytes());
+	m_pControl->writerWaiting.store(0);
+	m_pControl->gopCached.store(m_GopBytes > 0 ? 1 : 0);
+	m_ReaderEpoch = m_pControl->readerEpoch.load();
+	// 读取端可能正等着上一个写入端重放，新的GOP从第一帧开始标记起点
+	m_isGopStartPending = true;
+	quint64 generation = m_pControl->generation.fetch_add(1) + 1;
+
+	LogInfo() << QString("resume persistent channel, key: %1, generation: %2\n").arg(m_MemoryKey0).arg(generation);
+
+	return true;
+}
+
+
+quint32 IPC::ControlMagic()
+{
+	// 布局不同魔数不同，两端布局不一致时挂载失败
+	return m_Layout == IPC::Layout::Mailbox ? MailboxMagic : ControlBlockMagic;
+}
+
+
+qsizetype IPC::RingCapacity()
+{
+	// 两条最大记录，与双缓冲的深度一致；另留出消息头的余量，保证一条完整消息总能一次放下
+	return IPCRing::Footprint(m_MaxBytes) * 2 + HeaderSlack;
+}
+
+
+qsizetype IPC::MailboxCapacity()
+{
+	// 一条消息 = 消息头 + 扩展头 + 消息体，留出与环形数据区相同的消息头余量
+	return m_MaxBytes + HeaderSlack;
+}
+
+
+bool IPC::ClaimRecords(const QVector<IPC::Buffer> &buffers, quint64 stream, quint32 extraFlags, char **payloads)
+{
+	// 重放起点不过期，否则加入的读取端一直等不到
+	qint64 deadline = m_TimeToLive > 0 && !(extraFlags & IPCRing::GopStart) ? IPCRing::Now() + (qint64)m_TimeToLive * 1000 : 0;
+	if (TryClaimRecords(buffers, stream, extraFlags, deadline, payloads)) {
+		return true;
+	}
+
+	// 读取端积压的消息已经过期，腾出空间给新消息，不必等读取端读走
+	qsizetype reclaimed = m_Ring.Reclaim(IPCRing::Now());
+	if (reclaimed == 0) {
+		return false;
+	}
+	m_pControl->expiredMessages.fetch_add(reclaimed);
+
+	return TryClaimRecords(buffers, stream, extraFlags, deadline, payloads);
+}
+
+
+bool IPC::TryClaimRecords(const QVector<IPC::Buffer> &buffers, quint64 stream, quint32 extraFlags, qint64 deadline, char **payloads)
+{
+	if (!HasCredit(buffers)) {
+		return false;
+	}
+
+	quint32 flags = IPCRing::StreamFlags(stream) | extraFlags;
+	for (int i = 0; i < buffers.size(); i++) {
+		payloads[i] = m_Ring.Claim(buffers[i].nbytes, i + 1 == buffers.size() ? flags | IPCRing::MessageEnd : flags, deadline);
+		if (IsNullPtr(payloads[i])) {
+			m_Ring.Rollback();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+bool IPC::HasCredit(const QVector<IPC::Buffer> &buffers)
+{
+	qint64 windowBytes = m_pControl->creditBytes.load(std::memory_order_relaxed);
+	qint64 windowRecords = m_pControl->creditRecords.load(std::memory_order_relaxed);
+	if (windowBytes <= 0 && windowRecords <= 0) {
+		return true;
+	}
+
+	// 读空时总能写入一条，超过窗口的大消息不会永远写不进去
+	qint64 used = m_Ring.Used();
+	if (used == 0) {
+		return true;
+	}
+
+	qint64 nbytes = 0;
+	for (const IPC::Buffer &buffer : buffers) {
+		nbytes += IPCRing::Footprint(buffer.nbytes);
+	}
+
+	return (windowBytes <= 0 || used + nbytes <= windowBytes)
+		&& (windowRecords <= 0 || m_Ring.UsedRecords() + buffers.size() <= windowRecords);
+}
+
+
+bool IPC::WaitWritable(const std::function<bool()> &claim, const QDeadlineTimer &deadline, IPC::WriteError &error)
+{
+	bool claimed = claim();
+	while (!claimed && !m_CancelToken.IsCanceled()) {
+		char state = m_pControl->state.load();
+		if (state == (char)CharType::Quit || state == (char)CharType::ReaderDetach) {
+			error = IPC::WriteError::NoReader;
+			return false;
+		}
+
+		if (deadline.hasExpired()) {
+			error = IPC::WriteError::Timeout;
+			return false;
+		}
+
+		// 先登记等待再检查一次空间，读取端释放空间后看到登记就会唤醒，不会错过
+		m_pControl->writerWaiting.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		claimed = claim();
+		if (!claimed) {
+			m_pWriterNotifier->Wait(WaitInterval(deadline));
+		}
+
+		m_pControl->writerWaiting.fetch_sub(1);
+	}
+
+	if (!claimed) {
+		error = IPC::WriteError::Canceling;
+		return false;
+	}
+
+	return true;
+}
+
+
+void IPC::NotifyReader()
+{
+	// 读取端正在等待才需要唤醒，避免每条记录都进一次内核
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_pControl->readerWaiting.load() > 0) {
+		m_pReaderNotifier->Notify();
+	}
+}
+
+
+void IPC::NotifyWriter()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_pControl->writerWaiting.load() > 0) {
+		m_pWriterNotifier->Notify();
+	}
+}
+
+
+bool IPC::WriteRecord(const QVector<IPC::Buffer> &buffers, quint64 stream, quint32 flags, const QDeadlineTimer &deadline, IPC::WriteError &error)
+{
+	for (const IPC::Buffer &buffer : buffers) {
+		if (buffer.nbytes > m_MaxBytes) {
+			error = IPC::WriteError::MemcopyFail;
+			return false;
+		}
+	}
+
+	// 所有分段都申请到空间才拷贝，任何一段放不下就整体回退等待
+	QVarLengthArray<char *, 8> payloads(buffers.size());
+	if (!WaitWritable([this, &buffers, stream, flags, &payloads]() { return ClaimRecords(buffers, stream, flags, payloads.data()); }, deadline, error)) {
+		return false;
+	}
+
+	for (int i = 0; i < buffers.size(); i++) {
+		std::memcpy(payloads[i], buffers[i].pData, buffers[i].nbytes);
+	}
+
+	m_Ring.Commit();
+	NotifyReader();
+
+	error = IPC::WriteError::NoError;
+
+	return true;
+}
+
+
+const IPCRing::Record *IPC::PeekRecord()
+{
+	// 过期的整条消息直接跳过并释放，不拷贝正文
+	qsizetype expired = m_Ring.DiscardExpired();
+	if (expired > 0) {
+		m_pControl->expiredMessages.fetch_add(expired);
+		m_Ring.Release();
+		NotifyWriter();
+	}
+
+	// 加入期间本流在重放起点之前的旧帧整条丢弃
+	const IPCRing::Record *pRecord = m_Ring.Peek();
+	while (!IsNullPtr(pRecord) && IsStaleBeforeGop(pRecord)) {
+		do {
+			bool end = pRecord->flags & IPCRing::MessageEnd;
+			m_Ring.Next();
+			if (end) {
+				break;
+			}
+		} while (!IsNullPtr(pRecord = m_Ring.Peek()));
+
+		m_Ring.Release();
+		NotifyWriter();
+
+		pRecord = m_Ring.Peek();
+	}
+
+	return pRecord;
+}
+
+
+const IPCRing::Record *IPC::WaitRecord(const QDeadlineTimer &deadline, IPC::ReadError &error)
+{
+	const IPCRing::Record *pRecord = PeekRecord();
+	while (IsNullPtr(pRecord) && !m_CancelToken.IsCanceled()) {
+		// 整条消息一次提交，等待数据时一定处于消息边界，可以先让出去处理控制通道
+		if (HasControl()) {
+			error = IPC::ReadError::ControlPending;
+			return nullptr;
+		}
+
+		// 写入端退出前提交的数据仍然读完，读空之后才报告退出
+		if (m_pControl->state.load() == (char)CharType::Quit) {
+			error = IPC::ReadError::Quit;
+			return nullptr;
+		}
+
+		if (deadline.hasExpired()) {
+			error = IPC::ReadError::Timeout;
+			return nullptr;
+		}
+
+		m_pControl->readerWaiting.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		pRecord = PeekRecord();
+		if (IsNullPtr(pRecord) && !HasControl()) {
+			m_pReaderNotifier->Wait(WaitInterval(deadline));
+		}
+
+		m_pControl->readerWaiting.fetch_sub(1);
+	}
+
+	if (IsNullPtr(pRecord)) {
+		error = IPC::ReadError::Canceling;
+		return nullptr;
+	}
+
+	// 写入端重启过，只通知一次，数据照常从下一条记录继续
+	quint64 generation = m_pControl->generation.load();
+	if (generation != m_Generation) {
+		m_Generation = generation;
+		LogInfo() << QString("writer restarted, key: %1, generation: %2\n").arg(m_MemoryKey0).arg(generation);
+		emit Discontinuity(generation);
+	}
+
+	return pRecord;
+}
+
+
+bool IPC::WriteMailbox(const QVector<IPC::Buffer> &buffers, IPC::WriteError &error)
+{
+	qint64 nbytes = 0;
+	for (const IPC::Buffer &buffer : buffers) {
+		nbytes += buffer.nbytes;
+	}
+
+	if (nbytes > m_Mailbox.Capacity()) {
+		LogWarning() << QString("message too large for mailbox, key: %1, bytes: %2\n").arg(m_MemoryKey0).arg(nbytes);
+		error = IPC::WriteError::TooLarge;
+		return false;
+	}
+
+	// 写入端独占自己的槽，写完再发布，读取端看不到写了一半的消息
+	char *pData = m_Mailbox.Back();
+	for (const IPC::Buffer &buffer : buffers) {
+		memcpy(pData, buffer.pData, buffer.nbytes);
+		pData += buffer.nbytes;
+	}
+
+	m_Mailbox.Publish(nbytes);
+	NotifyReader();
+
+	error = IPC::WriteError::NoError;
+
+	return true;
+}
+
+
+bool IPC::ReadMailbox(QByteArray &content, qsizetype nbytes, const QDeadlineTimer &deadline, IPC::ReadError &error)
+{
+	// 只在没有新消息时等待写入端发布，不会让写入端等待
+	while (!m_Mailbox.Acquire()) {
+		if (m_CancelToken.IsCanceled()) {
+			error = IPC::ReadError::Canceling;
+			return false;
+		}
+
+		if (m_pControl->state.load() == (char)CharType::Quit) {
+			error = IPC::ReadError::Quit;
+			return false;
+		}
+
+		if (deadline.hasExpired()) {
+			error = IPC::ReadError::Timeout;
+			return false;
+		}
+
+		m_pControl->readerWaiting.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (!m_Mailbox.HasFresh()) {
+			m_pReaderNotifier->Wait(WaitInterval(deadline));
+		}
+
+		m_pControl->readerWaiting.fetch_sub(1);
+	}
+
+	quint64 generation = m_pControl->generation.load();
+	if (generation != m_Generation) {
+		m_Generation = generation;
+		LogInfo() << QString("writer restarted, key: %1, generation: %2\n").arg(m_MemoryKey0).arg(generation);
+		emit Discontinuity(generation);
+	}
+
+	qsizetype size = 0;
+	quint64 sequence = 0;
+	const char *pData = m_Mailbox.Front(size, sequence);
+	content.append(pData, qMin(nbytes, size));
+
+	error = IPC::ReadError::NoError;
+
+	return true;
+}
+
+
+bool IPC::WriteMessage(const QVector<IPC::Buffer> &buffers, quint64 stream, const QDeadlineTimer &deadline, IPC::WriteError &error)
+{
+	if (m_CombineBytes <= 0) {
+		return WriteRecord(buffers, stream, 0, deadline, error);
+	}
+
+	// 合并后的大小：流编号 + 分段数 + 各段长度 + 各段内容
+	qint64 nbytes = sizeof(quint32) * (2 + buffers.size());
+	for (const IPC::Buffer &buffer : buffers) {
+		nbytes += buffer.nbytes;
+	}
+
+	// 大消息不合并，先把已合并的提交，保证顺序
+	if (nbytes > m_CombineBytes) {
+		return FlushCombined(deadline, error) && WriteRecord(buffers, stream, 0, deadline, error);
+	}
+
+	if (m_CombineBuffer.size() + nbytes > m_CombineBytes && !FlushCombined(deadline, error)) {
+		return false;
+	}
+
+	if (m_CombineBuffer.isEmpty()) {
+		m_CombineTimer.start();
+	}
+
+	quint32 header[2] = { (quint32)stream, (quint32)buffers.size() };
+	m_CombineBuffer.append((const char *)header, sizeof(header));
+	for (const IPC::Buffer &buffer : buffers) {
+		quint32 size = (quint32)buffer.nbytes;
+		m_CombineBuffer.append((const char *)&size, sizeof(size));
+	}
+	for (const IPC::Buffer &buffer : buffers) {
+		m_CombineBuffer.append(buffer.pData, buffer.nbytes);
+	}
+
+	// 攒够字节数或超过延迟预算就提交
+	if (m_CombineBuffer.size() >= m_CombineBytes || m_CombineTimer.nsecsElapsed() >= (qint64)m_CombineBudget * 1000) {
+		return FlushCombined(deadline, error);
+	}
+
+	error = IPC::WriteError::NoError;
+
+	return true;
+}
+
+
+bool IPC::FlushCombined(const QDeadlineTimer &deadline, IPC::WriteError &error)
+{
+	error = IPC::WriteError::NoError;
+	if (m_CombineBuffer.isEmpty()) {
+		return true;
+	}
+
+	if (!WriteRecord({ { m_CombineBuffer.constData(), m_CombineBuffer.size() } }, 0, IPCRing::Combined, deadline, error)) {
+		return false;
+	}
+
+	m_CombineBuffer.clear();
+
+	return true;
+}
+
+
+void IPC::Unpack(const IPCRing::Record *pRecord)
+{
+	ForEachCombined(pRecord, [this](quint64 stream, const QVector<IPC::Buffer> &segments) {
+		// 合并进来的本流旧帧同样在加入期间丢弃
+		if (m_isJoining && stream == m_index) {
+			return;
+		}
+
+		UnpackedMessage message = { stream, {} };
+		for (const IPC::Buffer &segment : segments) {
+			message.segments.append(QByteArray(segment.pData, segment.nbytes));
+		}
+
+		m_Unpacked.enqueue(message);
+	});
+}
+
+
+bool IPC::ForEachCombined(const IPCRing::Record *pRecord, const std::function<void(quint64 stream, const QVector<IPC::Buffer> &segments)> &callback)
+{
+	const char *pData = IPCRing::Payload(pRecord);
+	const char *pEnd = pData + pRecord->size;
+
+	while (pData < pEnd) {
+		quint32 header[2] = { 0, 0 };
+		if (pEnd - pData < (qint64)sizeof(header)) {
+			LogWarningC("combined record truncated\n");
+			return false;
+		}
+
+		std::memcpy(header, pData, sizeof(header));
+		pData += sizeof(header);
+
+		if (pEnd - pData < (qint64)(sizeof(quint32) * header[1])) {
+			LogWarningC("combined record truncated\n");
+			return false;
+		}
+
+		const char *pSizes = pData;
+		pData += sizeof(quint32) * header[1];
+
+		QVarLengthArray<IPC::Buffer, 8> segments;
+		for (quint32 i = 0; i < header[1]; i++) {
+			quint32 size = 0;
+			std::memcpy(&size, pSizes + sizeof(quint32) * i, sizeof(size));
+			if (pEnd - pData < (qint64)size) {
+				LogWarningC("combined record truncated\n");
+				return false;
+			}
+
+			segments.append({ pData, size });
+			pData += size;
+		}
+
+		callback(header[0], QVector<IPC::Buffer>(segments.begin(), segments.end()));
+	}
+
+	return true;
+}
+
+
+void IPC::SetCombining(qint64 maxBytes, qint32 usBudget)
+{
+	IPC::WriteError error;
+	Flush(error);
+
+	std::lock_guard<std::mutex> locker(m_WriteMutex);
+
+	// 合并记录不能超过一条记录的上限
+	m_CombineBytes = m_Layout == IPC::Layout::Single ? qMin<qint64>(maxBytes, m_MaxBytes) : 0;
+	m_CombineBudget = qMax(usBudget, 0);
+
+	// 没有新消息时由定时任务按延迟预算提交，精度为毫秒
+	TaskPool::GetInstance()->RemoveIntervalTask("FlushCombined", false);
+	if (m_CombineBytes > 0) {
+		TaskPool::GetInstance()->SubmitIntervalTask(
+			"FlushCombined", this, qMax(m_CombineBudget / 1000, 1),
+			[](void *ptr) {
+				IPC *pThis = (IPC *)ptr;
+				pThis->FlushExpired();
+				return true;
+			}
+		);
+	}
+}
+
+
+bool IPC::Flush(IPC::WriteError &error)
+{
+	std::lock_guard<std::mutex> locker(m_WriteMutex);
+
+	return FlushCombined(QDeadlineTimer(QDeadlineTimer::Forever), error);
+}
+
+
+void IPC::FlushExpired()
+{
+	std::unique_lock<std::mutex> locker(m_WriteMutex, std::try_to_lock);
+	if (!locker.owns_lock() || m_Type != IPC::Type::Writer) {
+		return;
+	}
+
+	if (m_CombineBuffer.isEmpty() || m_CombineTimer.nsecsElapsed() < (qint64)m_CombineBudget * 1000) {
+		return;
+	}
+
+	// 定时任务不等待空间，放不下就留到下一次
+	IPC::WriteError error;
+	FlushCombined(QDeadlineTimer(0), error);
+}
+
+
+bool IPC::ReadRecord(QByteArray &content, qsizetype nbytes, const QDeadlineTimer &deadline, IPC::ReadError &error)
+{
+	while (m_Unpacked.isEmpty()) {
+		const IPCRing::Record *pRecord = WaitRecord(deadline, error);
+		if (IsNullPtr(pRecord)) {
+			return false;
+		}
+
+		// 合并记录先拆成单条消息，再逐段返回
+		if (pRecord->flags & IPCRing::Combined) {
+			Unpack(pRecord);
+			m_Ring.Next();
+			m_Ring.Release();
+			NotifyWriter();
+			continue;
+		}
+
+		content.append(IPCRing::Payload(pRecord), qMin<qsizetype>(nbytes, pRecord->size));
+		m_Ring.Next();
+		m_Ring.Release();
+		NotifyWriter();
+
+		error = IPC::ReadError::NoError;
+
+		return true;
+	}
+
+	UnpackedMessage &message = m_Unpacked.head();
+	QByteArray segment = message.segments.takeFirst();
+	content.append(segment.constData(), qMin<qsizetype>(nbytes, segment.size()));
+	if (message.segments.isEmpty()) {
+		m_Unpacked.dequeue();
+	}
+
+	error = IPC::ReadError::NoError;
+
+	return true;
+}
+
+
+bool IPC::WriteStream(quint64 stream, const QVector<IPC::Buffer> &buffers, IPC::WriteError &error)
+{
+	if (m_Type != IPC::Type::Writer) {
+		error = IPC::WriteError::Stopped;
+		return false;
+	}
+
+	if (m_CancelToken.IsCanceled()) {
+		error = IPC::WriteError::Canceling;
+		return false;
+	}
+
+	// 双缓冲没有记录头，无法标记流编号
+	if (m_Layout != IPC::Layout::Single || stream > IPCRing::MaxStream) {
+		error = IPC::WriteError::Stopped;
+		return false;
+	}
+
+	std::lock_guard<std::mutex> locker(m_WriteMutex);
+
+	return WriteMessage(buffers, stream, QDeadlineTimer(QDeadlineTimer::Forever), error);
+}
+
+
+bool IPC::ReadMessage(QByteArray &content, quint64 &stream, IPC::ReadError &error)
+{
+	return ReadMessage(content, stream, QDeadlineTimer(QDeadlineTimer::Forever), error);
+}
+
+
+bool IPC::ReadMessage(QByteArray &content, quint64 &stream, QDeadlineTimer deadline, IPC::ReadError &error)
+{
+	if (m_Type != IPC::Type::Reader || m_Layout == IPC::Layout::Triple) {
+		error = IPC::ReadError::Stopped;
+		return false;
+	}
+
+	if (m_CancelToken.IsCanceled()) {
+		error = IPC::ReadError::Canceling;
+		return false;
+	}
+
+	// 邮箱里的一条就是一条完整的消息
+	if (m_Layout == IPC::Layout::Mailbox) {
+		stream = m_index;
+		return ReadMailbox(content, m_Mailbox.Capacity(), deadline, error);
+	}
+
+	const IPCRing::Record *pRecord = nullptr;
+	while (m_Unpacked.isEmpty()) {
+		pRecord = WaitRecord(deadline, error);
+		if (IsNullPtr(pRecord)) {
+			return false;
+		}
+
+		if (!(pRecord->flags & IPCRing::Combined)) {
+			break;
+		}
+
+		Unpack(pRecord);
+		m_Ring.Next();
+		m_Ring.Release();
+		NotifyWriter();
+	}
+
+	// 合并记录拆出的消息
+	if (!m_Unpacked.isEmpty()) {
+		UnpackedMessage message = m_Unpacked.dequeue();
+		stream = message.stream;
+		for (const QByteArray &segment : message.segments) {
+			content.append(segment);
+		}
+
+		error = IPC::ReadError::NoError;
+
+		return true;
+	}
+
+	// 一条消息的所有记录一起提交，看到第一条就能读到最后一条
+	stream = IPCRing::Stream(pRecord);
+	while (!IsNullPtr(pRecord)) {
+		content.append(IPCRing::Payload(pRecord), pRecord->size);
+		bool end = pRecord->flags & IPCRing::MessageEnd;
+		m_Ring.Next();
+		if (end) {
+			break;
+		}
+
+		pRecord = m_Ring.Peek();
+	}
+
+	m_Ring.Release();
+	NotifyWriter();
+
+	error = IPC::ReadError::NoError;
+
+	return true;
+}
+
+
+bool IPC::ReadBatch(QVector<IPC::RecordView> &views, qsizetype maxRecords, qint64 maxBytes, IPC::ReadError &error, QDeadlineTimer deadline)
+{
+	views.clear();
+	m_BatchHold.clear();
+
+	if (m_Type != IPC::Type::Reader || m_Layout != IPC::Layout::Single) {
+		error = IPC::ReadError::Stopped;
+		return false;
+	}
+
+	if (m_CancelToken.IsCanceled()) {
+		error = IPC::ReadError::Canceling;
+		return false;
+	}
+
+	// 先返回此前从合并记录拆出但还没读走的消息，由本地保存到ReleaseBatch
+	while (!m_Unpacked.isEmpty() && views.size() < maxRecords) {
+		UnpackedMessage message = m_Unpacked.dequeue();
+		for (int i = 0; i < message.segments.size(); i++) {
+			m_BatchHold.append(message.segments[i]);
+			views.append({ m_BatchHold.last().constData(), m_BatchHold.last().size(), message.stream, i + 1 == message.segments.size() });
+		}
+	}
+
+	if (!views.isEmpty()) {
+		error = IPC::ReadError::NoError;
+		return true;
+	}
+
+	// 至少等到一条记录，之后只取调用时已提交的记录，不再等待
+	const IPCRing::Record *pRecord = WaitRecord(deadline, error);
+	if (IsNullPtr(pRecord)) {
+		return false;
+	}
+
+	qint64 nbytes = 0;
+	while (!IsNullPtr(pRecord) && views.size() < maxRecords) {
+		// 第一条记录总是返回，即使超过maxBytes
+		if (!views.isEmpty() && nbytes + pRecord->size > maxBytes) {
+			break;
+		}
+
+		// 合并记录整条展开，视图直接指向共享内存中的各段；展开后超过maxRecords时留给下一批，第一条记录总是返回
+		// 加入期间本流的旧帧留给下一批，由PeekRecord丢弃
+		if (!views.isEmpty() && IsStaleBeforeGop(pRecord)) {
+			break;
+		}
+
+		if (pRecord->flags & IPCRing::Combined) {
+			bool joining = m_isJoining;
+			quint64 index = m_index;
+			qsizetype segments = 0;
+			ForEachCombined(pRecord, [&segments, joining, index](quint64 stream, const QVector<IPC::Buffer> &buffers) {
+				if (!joining || stream != index) {
+					segments += buffers.size();
+				}
+			});
+			if (!views.isEmpty() && views.size() + segments > maxRecords) {
+				break;
+			}
+
+			ForEachCombined(pRecord, [&views, joining, index](quint64 stream, const QVector<IPC::Buffer> &segments) {
+				if (joining && stream == index) {
+					return;
+				}
+
+				for (int i = 0; i < segments.size(); i++) {
+					views.append({ segments[i].pData, segments[i].nbytes, stream, i + 1 == segments.size() });
+				}
+			});
+		}
+		else {
+			views.append({ IPCRing::Payload(pRecord), pRecord->size, IPCRing::Stream(pRecord), (pRecord->flags & IPCRing::MessageEnd) != 0 });
+		}
+		nbytes += pRecord->size;
+
+		// 批次中间过期的消息同样跳过，随整批一起释放
+		m_Ring.Next();
+		qsizetype expired = m_Ring.DiscardExpired();
+		if (expired > 0) {
+			m_pControl->expiredMessages.fetch_add(expired);
+		}
+		pRecord = m_Ring.Peek();
+	}
+
+	error = IPC::ReadError::NoError;
+
+	return true;
+}
+
+
+void IPC::ReleaseBatch()
+{
+	if (m_Type != IPC::Type::Reader || !m_Ring.IsAttached()) {
+		return;
+	}
+
+	// 整批记录一次释放，只更新一次读取位置
+	m_Ring.Release();
+	NotifyWriter();
+}
+
+
+quint64 IPC::Index()
+{
+	return m_index;
+}
+
+
+qintptr IPC::WakeHandle()
+{
+	IPCNotifier *pNotifier = WakeNotifier();
+	if (IsNullPtr(pNotifier)) {
+		return -1;
+	}
+
+	return pNotifier->Handle();
+}
+
+
+bool IPC::Watch(bool enable)
+{
+	if (enable == m_isWatching) {
+		return true;
+	}
+
+	// 对端只在本端登记等待时才唤醒，监听期间一直保持登记
+	if (enable && (IsNullPtr(m_pControl) || WakeHandle() < 0)) {
+		return false;
+	}
+
+	if (!IsNullPtr(m_pControl)) {
+		std::atomic<quint32> &waiting = m_Type == IPC::Type::Writer ? m_pControl->writerWaiting : m_pControl->readerWaiting;
+		if (enable) {
+			waiting.fetch_add(1);
+		}
+		else {
+			waiting.fetch_sub(1);
+		}
+	}
+
+	m_isWatching = enable;
+
+	return true;
+}
+
+
+bool IPC::IsReadable()
+{
+	if (m_Type != IPC::Type::Reader || IsNullPtr(m_pControl)) {
+		return false;
+	}
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (m_Layout == IPC::Layout::Mailbox) {
+		return m_Mailbox.HasFresh() || m_pControl->state.load() == (char)CharType::Quit;
+	}
+
+	// 只探测不占用读取位置，否则探测之后不读会一直挡住写入端回收过期消息
+	return !m_Unpacked.isEmpty() || m_Ring.HasPending() || HasControl() || m_pControl->state.load() == (char)CharType::Quit;
+}
+
+
+bool IPC::WaitReadable(QDeadlineTimer deadline, IPC::ReadError &error)
+{
+	if (m_Type != IPC::Type::Reader) {
+		error = IPC::ReadError::Stopped;
+		return false;
+	}
+
+	// 双缓冲读取会直接取走数据，只能等到截止时间
+	if (m_Layout == IPC::Layout::Triple) {
+		InterruptibleSleep(WaitInterval(deadline));
+		error = m_CancelToken.IsCanceled() ? IPC::ReadError::Canceling : IPC::ReadError::Timeout;
+		return false;
+	}
+
+	if (IsNullPtr(m_pControl)) {
+		error = IPC::ReadError::Stopped;
+		return false;
+	}
+
+	while (!IsReadable()) {
+		if (m_CancelToken.IsCanceled()) {
+			error = IPC::ReadError::Canceling;
+			return false;
+		}
+
+		if (deadline.hasExpired()) {
+			error = IPC::ReadError::Timeout;
+			return false;
+		}
+
+		// 先登记等待再检查一次，写入端提交后看到登记就会唤醒
+		m_pControl->readerWaiting.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (!IsReadable()) {
+			m_pReaderNotifier->Wait(WaitInterval(deadline));
+		}
+
+		m_pControl->readerWaiting.fetch_sub(1);
+	}
+
+	error = IPC::ReadError::NoError;
+
+	return true;
+}
+
+
+bool IPC::IsPeerQuit()
+{
+	if (IsNullPtr(m_pControl)) {
+		return false;
+	}
+
+	char state = m_pControl->state.load();
+	if (m_Type == IPC::Type::Writer) {
+		return state == (char)CharType::Quit || state == (char)CharType::ReaderDetach;
+	}
+
+	return state == (char)CharType::Quit;
+}
+
+
+void IPC::ConsumeWakeup()
+{
+	IPCNotifier *pNotifier = WakeNotifier();
+	if (!IsNullPtr(pNotifier)) {
+		pNotifier->Drain();
+	}
+}
+
+
+IPCNotifier *IPC::WakeNotifier()
+{
+	// 读取端等数据，被写入端提交时唤醒；写入端等空间，被读取端释放时唤醒
+	if (m_Type == IPC::Type::Reader) {
+		return m_pReaderNotifier;
+	}
+	else if (m_Type == IPC::Type::Writer) {
+		return m_pWriterNotifier;
+	}
+
+	return nullptr;
+}
+
+
+bool IPC::HasControlLane()
+{
+	return m_Layout == IPC::Layout::Single && !IsNullPtr(m_pControl);
+}
+
+
+bool IPC::WriteControl(const QVector<IPC::Buffer> &buffers, bool fenced, IPC::WriteError &error)
+{
+	if (m_Type != IPC::Type::Writer) {
+		error = IPC::WriteError::Stopped;
+		return false;
+	}
+
+	if (m_CancelToken.IsCanceled()) {
+		error = IPC::WriteError::Canceling;
+		return false;
+	}
+
+	if (!HasControlLane()) {
+		return Write(buffers, error);
+	}
+
+	// 栅栏 + 拼接后的整条消息
+	qint64 nbytes = sizeof(quint64);
+	for (const IPC::Buffer &buffer : buffers) {
+		nbytes += buffer.nbytes;
+	}
+
+	if (IPCRing::Footprint(nbytes) * 2 > ControlRingCapacity) {
+		error = IPC::WriteError::MemcopyFail;
+		return false;
+	}
+
+	// 有序事件之前合并中的消息要先提交，栅栏才能覆盖它们
+	if (fenced && !Flush(error)) {
+		return false;
+	}
+
+	// 控制通道有自己的锁，不与视频帧争用
+	std::lock_guard<std::mutex> locker(m_ControlMutex);
+
+	// 每条控制消息只占一条记录，带上MessageEnd，与数据环保持一致，否则Release不会清除Held
+	char *pPayload = nullptr;
+	if (!WaitWritable([this, nbytes, &pPayload]() { return !IsNullPtr(pPayload = m_ControlRing.Claim(nbytes, IPCRing::MessageEnd)); }, QDeadlineTimer(QDeadlineTimer::Forever), error)) {
+		return false;
+	}
 
-	LogInfoC(attached ? "attached\n" : "cancelled\n");
+	// 有序事件记下此刻数据通道已提交的位置，读取端读到这里之后才会交付
+	quint64 fence = fenced ? m_Ring.Committed() : 0;
+	std::memcpy(pPayload, &fence, sizeof(fence));
+	pPayload += sizeof(fence);
 
-	if (attached) {
-		// ÿ300һ
-		TaskPool::GetInstance()->SubmitIntervalTask(
-			"KeepReaderAlive", this, 300,
-			[](void *ptr) {
-				IPC *pThis = (IPC *)ptr;
-				pThis->KeepReaderAlive();
-				return true;
-			}
-		);
+	for (const IPC::Buffer &buffer : buffers) {
+		std::memcpy(pPayload, buffer.pData, buffer.nbytes);
+		pPayload += buffer.nbytes;
 	}
 
-	return attached;
+	m_ControlRing.Commit();
+	NotifyReader();
+
+	error = IPC::WriteError::NoError;
+
+	return true;
 }
 
 
-bool IPC::WaitUntilReaderAttached(qint32 msTimeout, bool lock)
+bool IPC::ReadControl(QByteArray &content, IPC::ReadError &error)
 {
-	qint64 ms = 0;
-	unsigned long timeout = 40;
-	while (!m_isCanceling && msTimeout > 0 && !IsReaderAttached(lock)) {
-		if (ms % 1000 == 0) {
-			LogInfo() << QString("milliseconds: %1\n").arg(ms);
-		}
-		ms += timeout;
-		msTimeout -= timeout;
-		QThread::msleep(timeout);
+	if (m_Type != IPC::Type::Reader) {
+		error = IPC::ReadError::Stopped;
+		return false;
 	}
 
-	bool attached = IsReaderAttached(lock);
+	if (!HasControl()) {
+		error = IPC::ReadError::NoData;
+		return false;
+	}
 
-	LogInfoC(attached ? "attached\n" : "cancelled\n");
+	const IPCRing::Record *pRecord = m_ControlRing.Peek();
+	const char *pPayload = IPCRing::Payload(pRecord);
 
-	if (!attached) {
+	content.append(pPayload + sizeof(quint64), pRecord->size - sizeof(quint64));
+	m_ControlRing.Next();
+	m_ControlRing.Release();
+	NotifyWriter();
+
+	error = IPC::ReadError::NoError;
+
+	return true;
+}
+
+
+bool IPC::HasControl()
+{
+	if (m_Type != IPC::Type::Reader || !HasControlLane()) {
 		return false;
 	}
 
-	if (attached) {
-		// ÿ300һ
-		TaskPool::GetInstance()->SubmitIntervalTask(
-			"KeepWriterAlive", this, 300,
-			[](void *ptr) {
-				IPC *pThis = (IPC *)ptr;
-				pThis->KeepWriterAlive();
-				return true;
-			}
-		);
+	const IPCRing::Record *pRecord = m_ControlRing.Peek();
+	if (IsNullPtr(pRecord)) {
+		return false;
 	}
 
-	//if (!lock) {
-	//	Lock(m_pSharedMemory1);
-	//}
-	SetCharType(m_pSharedMemory1, (char)CharType::InitForWriting, false);
-
-	//if (!lock) {
-	//	Lock(m_pSharedMemory2);
-	//}
-	SetCharType(m_pSharedMemory2, (char)CharType::InitForWriting, false);
-
-	// ڵǰʱϼһ10룬ֹʱӳ
-	KeepWriterAlive(10 * 1000);
+	// 有序事件要等数据通道读过栅栏位置，合并记录拆出的消息也要先读完
+	quint64 fence = 0;
+	std::memcpy(&fence, IPCRing::Payload(pRecord), sizeof(fence));
 
-	return attached;
+	return fence == 0 || (fence <= m_Ring.ReadCursor() && m_Unpacked.isEmpty());
 }
 
 
-bool IPC::Write(QByteArray &content, IPC::WriteError &error, bool lock)
+bool IPC::HasParameterBlock()
 {
-	return Write(content.constData(), content.size(), error, lock);
+	return m_Layout != IPC::Layout::Triple && m_Parameters.IsAttached();
 }
 
 
-bool IPC::Write(const char *buffer, qint64 nbytes, IPC::WriteError &error, bool lock)
+bool IPC::PublishParameter(IPCParameterBlock::Parameter parameter, qint32 value, IPC::WriteError &error)
 {
-	if (m_Type != IPC::Type::Writer) {
+	if (m_Type != IPC::Type::Writer || !HasParameterBlock()) {
 		error = IPC::WriteError::Stopped;
 		return false;
 	}
 
-	if (m_isCanceling) {
-		error = IPC::WriteError::Canceling;
-		return false;
-	}
+	// 顺序锁只允许一个发布者
+	std::lock_guard<std::mutex> locker(m_ParameterMutex);
+	m_Parameters.Publish(parameter, value);
 
-	errno_t err = 0;
-	char type = 0;
-	qint64 ms = 0;
-	unsigned long timeout = 4;
-	while (!m_isCanceling) {
-		if (lock && !Lock()) {
-			error = IPC::WriteError::LockFail;
+	error = IPC::WriteError::NoError;
 
-			QThread::msleep(timeout);
-			ms += timeout;
+	return true;
+}
 
-			continue;
-		}
 
-		type = GetCharType(m_pSharedMemory, !lock);
-		if (type == 0) {
-			IncrCharType(m_pSharedMemory, !lock);
+bool IPC::SampleParameters(IPCParameterBlock::Snapshot &snapshot)
+{
+	if (m_Type != IPC::Type::Reader || !HasParameterBlock()) {
+		return false;
+	}
 
-			err = memcpy_s((char *)m_pSharedMemory->data() + 1, m_MaxBytes, buffer, nbytes);
+	// 先比较代数，没有变化时不必取快照
+	if (m_Parameters.Generation() == m_ParameterGeneration) {
+		return false;
+	}
 
-			break;
-		}
+	// 写入端停在发布中途时取不到，保留上一次的参数
+	if (!m_Parameters.Sample(snapshot)) {
+		return false;
+	}
+	m_ParameterGeneration = snapshot.generation;
 
-		if (lock && !Unlock()) {
-			error = IPC::WriteError::UnlockFail;
-		}
+	return true;
+}
 
-		if (ms > 0 && ms % 1000 == 0) {
-			LogInfo() << QString("wait space, milliseconds: %1\n").arg(ms);
-		}
 
-		QThread::msleep(timeout);
-		ms += timeout;
+bool IPC::PublishExtradata(qint32 codec, const char *pData, qint64 nbytes, IPC::WriteError &error)
+{
+	if (m_Type != IPC::Type::Writer || !HasParameterBlock()) {
+		error = IPC::WriteError::Stopped;
+		return false;
 	}
 
-	if (lock && !Unlock()) {
-		error = IPC::WriteError::UnlockFail;
+	if (nbytes > IPCExtradata::Capacity) {
+		LogWarning() << QString("extradata too large, key: %1, bytes: %2\n").arg(m_MemoryKey0).arg(nbytes);
+		error = IPC::WriteError::TooLarge;
+		return false;
 	}
 
-	if (err != 0) {
-		error = IPC::WriteError::MemcopyFail;
-		return false;
+	std::lock_guard<std::mutex> locker(m_ParameterMutex);
+	if (m_Extradata.Publish(codec, pData, nbytes)) {
+		LogInfo() << QString("extradata changed, key: %1, codec: %2, bytes: %3\n").arg(m_MemoryKey0).arg(codec).arg(nbytes);
 	}
 
-	Swap();
+	error = IPC::WriteError::NoError;
 
-	if (m_isCanceling) {
-		error = IPC::WriteError::Canceling;
+	return true;
+}
+
+
+bool IPC::FetchExtradata(qint32 &codec, QByteArray &extradata)
+{
+	if (m_Type != IPC::Type::Reader || !HasParameterBlock()) {
 		return false;
 	}
 
-	bool status = false;
-	if (type > 0) {
-		error = IPC::WriteError::NoSpace;
+	// 还没发布过或者版本没变，不必拷贝
+	quint64 version = m_Extradata.Version();
+	if (version == 0 || version == m_ExtradataVersion) {
+		return false;
 	}
-	else if (type == 0) {
-		error = IPC::WriteError::NoError;
-		status = true;
+
+	// 写入端停在发布中途时取不到，由调用方改用码流中的参数集
+	quint64 fetched = m_Extradata.Fetch(codec, extradata);
+	if (fetched == 0) {
+		return false;
 	}
-	else {
-		error = IPC::WriteError::NoReader;
+	m_ExtradataVersion = fetched;
+
+	return true;
+}
+
+
+quint64 IPC::ExtradataVersion()
+{
+	if (!HasParameterBlock()) {
+		return 0;
 	}
 
-	return status;
+	return m_Extradata.Version();
 }
 
 
-qint32 IPC::ReadInt32(IPC::ReadError &error, bool lock)
+bool IPC::HasFeedbackLane()
 {
-	qint32 nbytes = -1;
+	return m_Layout == IPC::Layout::Single && m_ReverseRing.IsAttached();
+}
 
-	QByteArray buffer;
-	bool status = Read(buffer, sizeof(qint32), error, lock);
-	if (!status) {
-		LogWarning() << QString("ipc read common header size fail, nbytes: %1, error: %2\n").arg(sizeof(qint32)).arg((qint32)error);
+
+bool IPC::SendFeedback(IPC::FeedbackType type, qint64 value, IPC::WriteError &error)
+{
+	if (m_Type != IPC::Type::Reader || !HasFeedbackLane()) {
+		error = IPC::WriteError::Stopped;
+		return false;
 	}
-	else {
-		std::memcpy(&nbytes, buffer.constData(), sizeof(qint32));
+
+	IPC::Feedback feedback = { type, value };
+
+	// 读取端不能被写入端拖住，满了直接返回，由调用方决定是否重发
+	{
+		std::lock_guard<std::mutex> locker(m_FeedbackMutex);
+		// 反馈同样是单条记录的完整消息
+		char *pPayload = m_ReverseRing.Claim(sizeof(feedback), IPCRing::MessageEnd);
+		if (IsNullPtr(pPayload)) {
+			error = IPC::WriteError::NoSpace;
+			return false;
+		}
+
+		memcpy(pPayload, &feedback, sizeof(feedback));
+		m_ReverseRing.Commit();
 	}
 
-	return nbytes;
+	// 写入端阻塞在写入或由事件循环监听时都会被唤醒
+	NotifyWriter();
+
+	error = IPC::WriteError::NoError;
+
+	return true;
 }
 
 
-bool IPC::Read(QByteArray &content, qsizetype nbytes, IPC::ReadError &error, bool lock)
+bool IPC::ReadFeedback(IPC::Feedback &feedback)
 {
-	if (m_Type != IPC::Type::Reader) {
-		error = IPC::ReadError::Stopped;
+	if (m_Type != IPC::Type::Writer || !HasFeedbackLane()) {
 		return false;
 	}
 
-	if (m_isCanceling) {
-		error = IPC::ReadError::Canceling;
+	std::lock_guard<std::mutex> locker(m_FeedbackMutex);
+	const IPCRing::Record *pRecord = m_ReverseRing.Peek();
+	if (IsNullPtr(pRecord)) {
 		return false;
 	}
 
-	char type = 0;
-	qint64 ms = 0;
-	unsigned long timeout = 4;
-	while (!m_isCanceling) {
-		if (lock && !Lock()) {
-			error = IPC::ReadError::LockFail;
+	// 两端版本不一致时大小对不上，跳过这一条
+	if (pRecord->size != sizeof(feedback)) {
+		LogWarningC("feedback size mismatch\n");
+		m_ReverseRing.Next();
+		m_ReverseRing.Release();
+		return false;
+	}
 
-			QThread::msleep(timeout);
-			ms += timeout;
+	memcpy(&feedback, IPCRing::Payload(pRecord), sizeof(feedback));
+	m_ReverseRing.Next();
+	m_ReverseRing.Release();
 
-			continue;
-		}
+	return true;
+}
 
-		type = GetCharType(m_pSharedMemory, !lock);
-		if (type > 0) {
-			DecrCharType(m_pSharedMemory, !lock);
 
-			content.append((const char *)m_pSharedMemory->constData() + 1, nbytes);
+bool IPC::HasFeedback()
+{
+	if (m_Type != IPC::Type::Writer || !HasFeedbackLane()) {
+		return false;
+	}
 
-			break;
-		}
+	std::lock_guard<std::mutex> locker(m_FeedbackMutex);
 
-		if (lock && !Unlock()) {
-			error = IPC::ReadError::UnlockFail;
-		}
+	return m_ReverseRing.HasPending();
+}
 
-		if (ms > 0 && ms % 1000 == 0) {
-			LogInfo() << QString("wait space, milliseconds: %1\n").arg(ms);
-		}
 
-		QThread::msleep(timeout);
-		ms += timeout;
+void IPC::SetControlState(char type)
+{
+	if (!IsNullPtr(m_pControl)) {
+		m_pControl->state.store(type);
 	}
+}
 
-	if (lock && !Unlock()) {
-		error = IPC::ReadError::UnlockFail;
-	}
 
-	Swap();
+bool IPC::StartNotifier(IPCNotifier *&pNotifier, const QString &key)
+{
+	if (IsNullPtr(pNotifier)) {
+		pNotifier = new IPCNotifier();
+	}
 
-	if (m_isCanceling) {
-		error = IPC::ReadError::Canceling;
+	if (!pNotifier->IsOpen() && !pNotifier->Open(key)) {
 		return false;
 	}
 
-	bool status = false;
-	if (type > 0) {
-		error = IPC::ReadError::NoError;
-		status = true;
-	}
-	else if (type == (char)IPC::CharType::Quit) {
-		error = IPC::ReadError::Quit;
-	}
-	else {
-		error = IPC::ReadError::NoData;
-	}
+	// 清除上次取消留下的打断状态
+	pNotifier->ResetInterrupt();
 
-	return status;
+	return true;
 }
 
 
-bool IPC::StartWriteShare(QSharedMemory *&pSharedMemory, QString &key)
+bool IPC::StopNotifier(IPCNotifier *&pNotifier, bool remove)
 {
-	if (IsNullPtr(pSharedMemory)) {
-		pSharedMemory = new QSharedMemory();
-		pSharedMemory->setKey(key);
-
-		if (!pSharedMemory->isAttached()) {
-			pSharedMemory->detach();
-		}
-
-		if (!pSharedMemory->create(pSharedMemory != m_pSharedMemory3 ? m_MaxBytes : 1 + sizeof(qint64) * 2)) {
-			return false;
+	if (!IsNullPtr(pNotifier)) {
+		if (remove) {
+			pNotifier->Remove();
 		}
+		pNotifier->Interrupt();
+		delete pNotifier;
+		pNotifier = nullptr;
 	}
 
 	return true;
 }
 
 
-bool IPC::StartReadShare(QSharedMemory *&pSharedMemory, QString &key)
+void IPC::NotifyPeer()
 {
-	if (IsNullPtr(pSharedMemory)) {
-		pSharedMemory = new QSharedMemory();
-		pSharedMemory->setKey(key);
+	if (m_Type == IPC::Type::Writer && !IsNullPtr(m_pReaderNotifier)) {
+		m_pReaderNotifier->Notify();
+	}
+	else if (m_Type == IPC::Type::Reader && !IsNullPtr(m_pWriterNotifier)) {
+		m_pWriterNotifier->Notify();
+	}
+}
 
-		if (!pSharedMemory->attach()) {
-			return false;
-		}
+
+void IPC::InterruptibleSleep(qint32 ms)
+{
+	// 等在本端的通知对象上，取消时被打断立即返回
+	IPCNotifier *pNotifier = WakeNotifier();
+	if (IsNullPtr(pNotifier) || !pNotifier->IsOpen()) {
+		QThread::msleep(ms);
+		return;
 	}
 
-	return true;
+	pNotifier->Wait(ms);
 }
 
 
-bool IPC::StopAllShare(QSharedMemory *&pSharedMemory)
+qint32 IPC::WaitInterval(const QDeadlineTimer &deadline)
 {
-	if (!IsNullPtr(pSharedMemory)) {
-		pSharedMemory->detach();
-		delete pSharedMemory;
-		pSharedMemory = nullptr;
+	// 不超过截止时间，也不超过兜底的最长休眠
+	if (deadline.isForever()) {
+		return WaitTimeout;
 	}
 
-	return true;
+	return (qint32)qBound<qint64>(0, deadline.remainingTime(), WaitTimeout);
 }
 
 
@@ -464,6 +2567,20 @@ void IPC::Swap()
 
 bool IPC::IsReaderAttached(bool lock)
 {
+	if (m_Layout != IPC::Layout::Triple) {
+		if (IsNullPtr(m_pControl)) {
+			return false;
+		}
+
+		// 与读取端上线竞争时以读取端为准，不能把已上线的状态覆盖掉
+		char state = m_pControl->state.load();
+		if (state != (char)CharType::ReaderAttach) {
+			m_pControl->state.compare_exchange_strong(state, (char)CharType::WaitReaderAttached);
+		}
+
+		return state == (char)CharType::ReaderAttach;
+	}
+
 	return IsReaderAttached(m_pSharedMemory1, lock) && IsReaderAttached(m_pSharedMemory2, lock) && IsReaderAttached(m_pSharedMemory3, lock);
 }
 
@@ -472,6 +2589,11 @@ bool IPC::IsWriterAlive(qint64 milliseconds)
 {
 	bool alive = true;
 
+	// 单块布局的心跳是原子量，无需加锁
+	if (!IsNullPtr(m_pControl)) {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() - m_pControl->writerHeartBeat.load() < milliseconds;
+	}
+
 	// lock
 	if (!IsNullPtr(m_pSharedMemory3) && m_pSharedMemory3 && m_pSharedMemory3->lock()) {
 		// read
@@ -492,6 +2614,10 @@ bool IPC::IsReaderAlive(qint64 milliseconds)
 {
 	bool alive = true;
 
+	if (!IsNullPtr(m_pControl)) {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() - m_pControl->readerHeartBeat.load() < milliseconds;
+	}
+
 	// lock
 	if (!IsNullPtr(m_pSharedMemory3) && m_pSharedMemory3 && m_pSharedMemory3->lock()) {
 		// read
@@ -512,6 +2638,11 @@ void IPC::KeepWriterAlive(qint64 milliseconds)
 {
 	qint64 ts = milliseconds + std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 
+	if (!IsNullPtr(m_pControl)) {
+		m_pControl->writerHeartBeat.store(ts);
+		return;
+	}
+
 	// lock
 	if (!IsNullPtr(m_pSharedMemory3) && m_pSharedMemory3->lock()) {
 		// write
@@ -531,6 +2662,11 @@ void IPC::KeepReaderAlive(qint64 milliseconds)
 {
 	qint64 ts = milliseconds + std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 
+	if (!IsNullPtr(m_pControl)) {
+		m_pControl->readerHeartBeat.store(ts);
+		return;
+	}
+
 	// lock
 	if (!IsNullPtr(m_pSharedMemory3) && m_pSharedMemory3->lock()) {
 		// write
@@ -585,6 +2721,10 @@ void IPC::SetReaderAttachChar(bool lock)
 	SetReaderAttachChar(m_pSharedMemory1, lock);
 	SetReaderAttachChar(m_pSharedMemory2, lock);
 	SetReaderAttachChar(m_pSharedMemory3, lock);
+	SetControlState((char)CharType::ReaderAttach);
+	JoinAtKeyframe();
+
+	NotifyPeer();
 }
 
 
@@ -599,6 +2739,9 @@ void IPC::SetQuitChar(bool lock)
 	SetQuitChar(m_pSharedMemory1, lock);
 	SetQuitChar(m_pSharedMemory2, lock);
 	SetQuitChar(m_pSharedMemory3, lock);
+	SetControlState((char)CharType::Quit);
+
+	NotifyPeer();
 }
 
 
@@ -613,6 +2756,9 @@ void IPC::SetReaderDetachChar(bool lock)
 	SetReaderDetachChar(m_pSharedMemory1, lock);
 	SetReaderDetachChar(m_pSharedMemory2, lock);
 	SetReaderDetachChar(m_pSharedMemory3, lock);
+	SetControlState((char)CharType::ReaderDetach);
+
+	NotifyPeer();
 }
 
 
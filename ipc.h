@@ -2,9 +2,24 @@
 
 // project
 #include "../task/pool.h"
+#include "cancel.h"
+#include "extradata.h"
+#include "mailbox.h"
+#include "notifier.h"
+#include "pacer.h"
+#include "params.h"
+#include "ring.h"
 
 // qt
+#include <QtCore/QDeadlineTimer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QQueue>
 #include <QtCore/QSharedMemory>
+#include <QtCore/QVector>
+
+// c/c++
+#include <functional>
+#include <mutex>
 
 
 
@@ -46,6 +61,10 @@ public:
         Canceling = -5,
         // 未启动
         Stopped = -6,
+        // 控制通道有待处理的消息，先调用ReadControl
+        ControlPending = -7,
+        // 超过截止时间
+        Timeout = -8,
     };
 
     // 共享内存写入错误
@@ -67,6 +86,10 @@ public:
         Canceling = -6,
         // 未启动
         Stopped = -7,
+        // 超过截止时间
+        Timeout = -8,
+        // 消息超过邮箱槽的容量
+        TooLarge = -9,
     };
 
     // 共享内存首字节类型
@@ -84,6 +107,74 @@ public:
         InitForWriting = 0,
     };
 
+    // 共享内存布局
+    enum class Layout
+    {
+        // 三块共享内存：两块双缓冲，一块写状态和心跳
+        Triple,
+        // 单块共享内存：控制块、心跳和环形数据区放在同一块映射中
+        Single,
+        // 单块共享内存的三缓冲邮箱：只保留最新的一条消息，写入端从不等待，读取端总是取到最新的一条
+        // 适合缩略图、预览这类只关心最新帧的读取端；没有控制通道，不支持多路复用和批量读取
+        Mailbox,
+    };
+
+    // 写入端背压策略，读取端跟不上时如何处理
+    enum class Backpressure
+    {
+        // 阻塞等待读取端腾出空间
+        Block,
+        // 丢弃P/B帧直到下一个I帧，I帧仍然阻塞等待
+        DropToKeyframe,
+    };
+
+    // 分段写入的一段内容
+    struct Buffer
+    {
+        const char *pData;
+        qint64 nbytes;
+    };
+
+    // 批量读取到的一条记录，指向共享内存
+    struct RecordView
+    {
+        const char *pData;
+        qint64 nbytes;
+        // 流编号
+        quint64 stream;
+        // 是否是一条消息的最后一条记录
+        bool messageEnd;
+    };
+
+    // 读取端发给写入端的反馈类型
+    enum class FeedbackType : quint32
+    {
+        // 请求立即编码一个I帧，用于丢帧或解码器重置之后，value无意义
+        KeyframeRequest = 1,
+        // 授予写入端可以继续发送的帧数，value为帧数
+        Credit = 2,
+        // 上报解码延迟，value为微秒
+        DecodeLatency = 3,
+    };
+
+    // 一条反馈
+    struct Feedback
+    {
+        IPC::FeedbackType type;
+        qint64 value;
+    };
+
+    // 读取端的订阅条件，写入端据此在源头跳过读取端不关心的消息，不再写入共享内存
+    struct Subscription
+    {
+        // 按CommonHead类型订阅，第n位对应类型值n，0表示全部
+        quint32 types;
+        // 按VideoHead帧类型订阅，第n位对应帧类型值n，0表示全部
+        quint32 frameTypes;
+        // 符合条件的视频帧每decimation帧取一帧，0和1表示不抽取
+        quint32 decimation;
+    };
+
 
 public:
     // 共享内存键和大小，注意平台差异
@@ -91,19 +182,28 @@ public:
     ~IPC();
 
     // 开启写入端
-    bool StartWriter(QString key, qsizetype maxBytes = DefaultMaxBytes, quint64 index = 0);
+    bool StartWriter(QString key, qsizetype maxBytes = DefaultMaxBytes, quint64 index = 0, IPC::Layout layout = IPC::Layout::Triple);
     // 终止写入端
     bool StopWriter();
 
     // 开启读取端
-    bool StartReader(QString key, qsizetype maxBytes = DefaultMaxBytes, quint64 index = 0);
+    bool StartReader(QString key, qsizetype maxBytes = DefaultMaxBytes, quint64 index = 0, IPC::Layout layout = IPC::Layout::Triple);
     // 终止读取端
     bool StopReader();
 
-    // 取消
+    // 常驻通道，仅单块布局有效(邮箱布局总是重新创建)，须在开启写入端/读取端之前设置
+    // 写入端退出时不销毁共享内存，重启后直接接管并递增代数，读取端无需重新握手
+    // 已有的数据区放不下本次的maxBytes时不接管，通知读取端退出后重新创建
+    void SetPersistent(bool persistent);
+    // 当前代数，写入端每重启一次加一
+    quint64 Generation();
+
+    // 取消，同时唤醒正在等待的线程和挂起的协程
     void Cancel();
     // 是否取消
     bool IsCanceling();
+    // 取消令牌，与本通道共享取消状态，可用于订阅取消
+    IPCCancelToken CancelToken();
 
     // 等待写入端上线
     bool WaitUntilWriterAttached(qint32 msTimeout, bool lock = true);
@@ -111,12 +211,140 @@ public:
     // 等待读取端上线
     bool WaitUntilReaderAttached(qint32 msTimeout, bool lock = true);
 
-    // 写入数据
+    // 写入数据，同一通道的多个线程并发写入时按消息互斥，不同通道之间互不影响
     bool Write(QByteArray &content, IPC::WriteError &error, bool lock = true);
     bool Write(const char *buffer, qint64 nbytes, IPC::WriteError &error, bool lock = true);
+    // 分段写入，每段一条记录；单块布局下所有分段一次提交，读取端不会看到半条消息
+    bool Write(const QVector<IPC::Buffer> &buffers, IPC::WriteError &error, bool lock = true);
+    // 最多等到deadline，超时返回Timeout；双缓冲只在写第一段之前检查截止时间，开始写入后一直等到整条消息写完
+    bool Write(const QVector<IPC::Buffer> &buffers, QDeadlineTimer deadline, IPC::WriteError &error, bool lock = true);
+    // 不等待，空间不足返回NoSpace；双缓冲只保证第一段不等待，后续分段等到写完为止
+    bool TryWrite(const QVector<IPC::Buffer> &buffers, IPC::WriteError &error, bool lock = true);
+    // 是否能立即写入，不阻塞；三块布局只看当前缓冲区，多段消息的后续分段仍可能阻塞
+    bool IsWritable(const QVector<IPC::Buffer> &buffers);
+
+    // 背压策略，默认阻塞；三块布局的一条消息逐段写入，无法事先判断能否整条写完，不支持DropToKeyframe，返回false
+    bool SetBackpressure(IPC::Backpressure policy);
+    IPC::Backpressure GetBackpressure();
+    // 开启时指定的布局
+    IPC::Layout GetLayout();
+    // 按背压策略判断这一帧是否应当丢弃
+    bool ShouldDropFrame(bool keyframe, const QVector<IPC::Buffer> &buffers);
+    // 累计丢弃的帧数
+    quint64 DroppedFrames();
+
+    // 订阅，仅单块和邮箱布局有效：读取端登记订阅条件，下线时自动清除
+    bool Subscribe(const IPC::Subscription &subscription);
+    // 写入端发送前判断读取端是否需要这条消息；frameType < 0 表示不是视频帧
+    bool IsSubscribed(qint32 type, qint32 frameType = -1);
+    // 因订阅条件累计跳过的消息数
+    quint64 FilteredMessages();
+
+    // 额度流控，仅单块布局有效：读取端给出在途数据的窗口(字节数、记录数，0表示不限)，已提交未读走的数据加上新消息超出窗口时视同空间不足
+    // 读取端调用，下线时自动清除
+    bool SetCreditWindow(qint64 bytes, qint64 records);
+    // 写入端剩余的额度，不加锁，编码器可据此提前降码率或丢帧；没有限制时为std::numeric_limits<qint64>::max()
+    qint64 CreditBytes();
+    qint64 CreditRecords();
+
+    // 消息有效期，仅单块布局的写入端有效：数据通道的消息提交后msTtl毫秒过期，0表示不过期，控制通道不受影响
+    // 读取端在消息边界直接跳过过期的消息，不拷贝；写入端空间不足时回收读取端还没开始读的过期消息
+    void SetTimeToLive(qint32 msTtl);
+    // 累计因过期被丢弃的消息数，含读取端跳过的和写入端回收的
+    quint64 ExpiredMessages();
+
+    // 按时间戳节流，仅写入端有效，适合回放录像文件：按帧的时间戳以实时速度(乘以倍速)放行，最多超前msLead毫秒，负数关闭
+    // ticksPerSecond为时间戳的单位；缓冲区只保留很浅的一段数据，倍速变化立即生效
+    void SetPacing(qint32 msLead, quint32 ticksPerSecond = 1000);
+    // 节流的倍速，取值同SetSpeed事件[-100, 100]
+    void SetPacingSpeed(qint32 speed);
+    // 等到这一帧可以发送，未开启节流时立即返回
+    bool PaceFrame(quint64 timestamp, IPC::WriteError &error);
+
+    // GOP缓存，仅单块布局有效：写入端在本地保留最近一个I帧及其后的帧，最多maxBytes字节，0表示关闭
+    // 开启后新上线的读取端丢弃环里积压的旧数据，写入端先重放缓存的GOP再接着写实时帧，读取端上线即可解码
+    void SetGopCache(qint64 maxBytes);
+    // 写入一帧视频，开启GOP缓存时同时更新缓存；未开启时等同于Write
+    bool WriteFrame(bool keyframe, const QVector<IPC::Buffer> &buffers, IPC::WriteError &error);
     // 读取数据
     qint32 ReadInt32(IPC::ReadError &error, bool lock = true);
     bool Read(QByteArray &content, qsizetype nbytes, IPC::ReadError &error, bool lock = true);
+    // 最多等到deadline，超时返回Timeout
+    bool Read(QByteArray &content, qsizetype nbytes, QDeadlineTimer deadline, IPC::ReadError &error, bool lock = true);
+    // 不等待，没有数据返回NoData
+    bool TryRead(QByteArray &content, qsizetype nbytes, IPC::ReadError &error, bool lock = true);
+
+    // 多路复用，仅单块布局有效；每条记录带流编号，Write默认使用开启时传入的index
+    // 写入一条属于stream的消息，stream不能超过IPCRing::MaxStream
+    bool WriteStream(quint64 stream, const QVector<IPC::Buffer> &buffers, IPC::WriteError &error);
+    // 读取一条完整的消息及其流编号，所有分段拼接在一起
+    bool ReadMessage(QByteArray &content, quint64 &stream, IPC::ReadError &error);
+    bool ReadMessage(QByteArray &content, quint64 &stream, QDeadlineTimer deadline, IPC::ReadError &error);
+
+    // 批量读取，仅单块布局有效：至少等到一条记录，然后取出调用时已提交的全部记录，最多maxRecords条视图、maxBytes字节
+    // 合并记录按拆出的分段计数，只有第一条合并记录可能超过maxRecords
+    // 返回的视图直接指向共享内存，不拷贝（合并记录在此前被逐条读取拆出的剩余消息除外）；处理完调用ReleaseBatch一次性释放，释放或再次读取之前视图保持有效
+    // 批次可能在消息中间截断，剩余的记录由下一次读取继续返回
+    bool ReadBatch(QVector<IPC::RecordView> &views, qsizetype maxRecords, qint64 maxBytes, IPC::ReadError &error,
+        QDeadlineTimer deadline = QDeadlineTimer(QDeadlineTimer::Forever));
+    // 释放ReadBatch取出的全部记录
+    void ReleaseBatch();
+    // 开启时传入的index，即本端默认的流编号
+    quint64 Index();
+
+    // 写入合并，仅单块布局的写入端有效：小于maxBytes的消息先攒在本地，攒够maxBytes或最早一条等待超过usBudget微秒后合成一条记录提交
+    // 读取端自动拆分，按原来的流编号和分段交付；maxBytes为0关闭合并，关闭前会先提交已攒的消息
+    void SetCombining(qint64 maxBytes, qint32 usBudget);
+    // 立即提交已合并的消息
+    bool Flush(IPC::WriteError &error);
+
+    // 事件驱动读写，仅单块布局有效：不再阻塞在Read/Write里，而是由事件循环监听唤醒句柄
+    // 唤醒句柄，读取端在写入端提交数据后可读，写入端在读取端释放空间后可读；未开启时为-1
+    qintptr WakeHandle();
+    // 开始/停止监听；监听期间对端每次提交或释放都会唤醒，不会错过通知
+    bool Watch(bool enable);
+    // 是否有可读的数据、控制消息或写入端已退出，不阻塞
+    bool IsReadable();
+    // 等到IsReadable为true，不取走数据；超时返回Timeout；三块布局无法探测，睡到截止时间后返回Timeout
+    bool WaitReadable(QDeadlineTimer deadline, IPC::ReadError &error);
+    // 对端是否已退出，写入端还包括读取端下线
+    bool IsPeerQuit();
+    // 事件循环报告可读后调用，消费掉积压的通知
+    void ConsumeWakeup();
+
+    // 是否有独立的控制通道，仅单块布局有
+    bool HasControlLane();
+    // 写入控制通道，所有分段拼成一条消息；fenced为true时读取端读完此前已提交的数据后才交付
+    // 没有控制通道时退化为写入数据通道
+    bool WriteControl(const QVector<IPC::Buffer> &buffers, bool fenced, IPC::WriteError &error);
+    // 读取控制通道的一条完整消息，不阻塞，格式同数据通道：消息头大小 + 消息头 + 扩展头 + 消息体
+    bool ReadControl(QByteArray &content, IPC::ReadError &error);
+    // 控制通道是否有可交付的消息
+    bool HasControl();
+
+    // 反向通道，仅单块布局有：读取端向写入端发送反馈，如请求I帧、授予额度、上报解码延迟
+    // 写入端可以轮询ReadFeedback，也可以把通道注册到IPCReactor，有反馈时回调
+    bool HasFeedbackLane();
+    // 读取端发送一条反馈，不阻塞，反向通道满时返回NoSpace
+    bool SendFeedback(IPC::FeedbackType type, qint64 value, IPC::WriteError &error);
+    // 写入端取出一条反馈，没有时返回false，不阻塞
+    bool ReadFeedback(IPC::Feedback &feedback);
+    // 写入端是否有未取出的反馈
+    bool HasFeedback();
+
+    // 参数块，仅单块布局有：连续调节的参数(滤镜、倍速)只保留最新值，不经过消息队列
+    bool HasParameterBlock();
+    // 写入端发布参数的最新值，覆盖此前尚未被读取的值
+    bool PublishParameter(IPCParameterBlock::Parameter parameter, qint32 value, IPC::WriteError &error);
+    // 读取端每帧调用一次，参数自上次采样后有变化才返回true并填充快照；写入端停在发布中途时返回false，沿用上一次的参数
+    bool SampleParameters(IPCParameterBlock::Snapshot &snapshot);
+
+    // 解码器配置(SPS/PPS/VPS)，与参数块在一起：写入端在配置变化时发布，内容相同的重复发布被忽略
+    bool PublishExtradata(qint32 codec, const char *pData, qint64 nbytes, IPC::WriteError &error);
+    // 读取端上线后或每帧调用，有新版本才返回true并拷贝出来；写入端停在发布中途时返回false，改用码流中的参数集
+    bool FetchExtradata(qint32 &codec, QByteArray &extradata);
+    // 当前版本，0表示还没有发布过
+    quint64 ExtradataVersion();
 
     // 读取端上线，通知写入端
     void SetReaderAttachChar(bool lock = true);
@@ -139,13 +367,138 @@ public slots:
     void KeepAlive();
 
 
+signals:
+    // 读取端发现写入端已重启，此后读到的是新写入端的数据
+    void Discontinuity(quint64 generation);
+    // 终止读取端/写入端之前发出，唤醒句柄此时仍然有效；在调用终止的线程中直接回调，监听者须在回调里解除对本通道的引用
+    void Stopping();
+
+
 private:
+    // 单块布局的控制块，位于共享内存起始位置，之后紧跟环形数据区
+    struct alignas(64) ControlBlock
+    {
+        // 魔数和版本，读取端挂载时校验；魔数最后写入
+        std::atomic<quint32> magic;
+        quint32 version;
+        // 状态，取值同CharType
+        std::atomic<char> state;
+        // 代数，常驻通道的写入端每接管一次加一
+        std::atomic<quint64> generation;
+        // 写入端/读取端心跳
+        std::atomic<qint64> writerHeartBeat;
+        std::atomic<qint64> readerHeartBeat;
+        // 写入端/读取端正在等待的线程数，对端据此决定是否需要唤醒
+        std::atomic<quint32> writerWaiting;
+        std::atomic<quint32> readerWaiting;
+        // 读取端的订阅条件，见Subscription
+        std::atomic<quint32> subscribedTypes;
+        std::atomic<quint32> subscribedFrameTypes;
+        std::atomic<quint32> decimation;
+        // 写入端是否开启了GOP缓存
+        std::atomic<quint32> gopCached;
+        // 读取端每次上线加一，写入端据此发现新的读取端
+        std::atomic<quint32> readerEpoch;
+        // 读取端给出的在途数据窗口，0表示不限
+        std::atomic<qint64> creditBytes;
+        std::atomic<qint64> creditRecords;
+        // 因过期被丢弃的消息数，两端都累加
+        std::atomic<quint64> expiredMessages;
+    };
+
+    static const quint32 ControlBlockMagic = 0x43504951;  // "QIPC"
+    static const quint32 MailboxMagic = 0x4D504951;  // "QIPM"
+    static const quint32 ControlBlockVersion = 11;
+    // 控制通道容量
+    static const qsizetype ControlRingCapacity = 64 * 1024;
+    // 反向通道容量，每条反馈只有十几个字节
+    static const qsizetype ReverseRingCapacity = 16 * 1024;
+    // 消息头的余量，最大的消息体加上消息头也能一次放下
+    static const qsizetype HeaderSlack = 4096;
+    // 单块布局等待对端时的最长休眠，对端异常退出时据此重新检查状态
+    static const qint32 WaitTimeout = 100;
+
     // 开启写入端共享内存
     bool StartWriteShare(QSharedMemory *&pSharedMemory, QString &key);
     // 开启读取端共享内存
     bool StartReadShare(QSharedMemory *&pSharedMemory, QString &key);
     // 终止写入端/读取端共享内存
     bool StopAllShare(QSharedMemory *&pSharedMemory);
+    // 共享内存大小
+    qsizetype SharedMemoryBytes(QSharedMemory *&pSharedMemory);
+
+    // 单块布局：写入端初始化控制块和环形数据区
+    void FormatSingleShare();
+    // 单块布局：读取端映射控制块和环形数据区
+    bool MapSingleShare();
+    // 常驻通道：写入端接管已存在的共享内存
+    bool ResumeSingleShare();
+    // 单块布局：控制块魔数，邮箱布局另用一个
+    quint32 ControlMagic();
+    // 单块布局：环形数据区容量
+    qsizetype RingCapacity();
+    // 邮箱布局：每个槽的容量
+    qsizetype MailboxCapacity();
+    // 单块布局：为一组记录申请空间，全部申请到才返回true；空间不足时先回收过期消息再试
+    bool ClaimRecords(const QVector<IPC::Buffer> &buffers, quint64 stream, quint32 extraFlags, char **payloads);
+    // 单块布局：按给定的截止时间申请一次
+    bool TryClaimRecords(const QVector<IPC::Buffer> &buffers, quint64 stream, quint32 extraFlags, qint64 deadline, char **payloads);
+    // 单块布局：读取端给出的额度窗口是否还容得下这条消息
+    bool HasCredit(const QVector<IPC::Buffer> &buffers);
+    // 单块布局：空间不足时等待读取端释放
+    bool WaitWritable(const std::function<bool()> &claim, const QDeadlineTimer &deadline, IPC::WriteError &error);
+    // 单块布局：对端正在等待时唤醒
+    void NotifyReader();
+    void NotifyWriter();
+    // 单块布局：写入一组记录，一次提交
+    bool WriteRecord(const QVector<IPC::Buffer> &buffers, quint64 stream, quint32 flags, const QDeadlineTimer &deadline, IPC::WriteError &error);
+    // 单块布局：写入一条消息，开启合并时小消息先攒在本地，调用方持有m_WriteMutex
+    bool WriteMessage(const QVector<IPC::Buffer> &buffers, quint64 stream, const QDeadlineTimer &deadline, IPC::WriteError &error);
+    // 提交已合并的消息，调用方持有m_WriteMutex
+    bool FlushCombined(const QDeadlineTimer &deadline, IPC::WriteError &error);
+    // 定时任务：最早一条合并的消息超过延迟预算时提交
+    void FlushExpired();
+    // 写入一段数据，调用方持有m_WriteMutex
+    bool WriteBuffer(const char *buffer, qint64 nbytes, const QDeadlineTimer &deadline, IPC::WriteError &error, bool lock);
+    // 单块布局：跳过消息边界上过期的消息后取下一条记录，不阻塞
+    const IPCRing::Record *PeekRecord();
+    // 单块布局：等待下一条记录，没有数据时阻塞
+    const IPCRing::Record *WaitRecord(const QDeadlineTimer &deadline, IPC::ReadError &error);
+    // 单块布局：读取一条记录
+    bool ReadRecord(QByteArray &content, qsizetype nbytes, const QDeadlineTimer &deadline, IPC::ReadError &error);
+    // 邮箱布局：所有分段拼成一条消息发布
+    bool WriteMailbox(const QVector<IPC::Buffer> &buffers, IPC::WriteError &error);
+    // 邮箱布局：等到有新消息后取最新的一条
+    bool ReadMailbox(QByteArray &content, qsizetype nbytes, const QDeadlineTimer &deadline, IPC::ReadError &error);
+    // GOP缓存：按帧类型更新缓存，调用方持有m_WriteMutex
+    void CacheFrame(bool keyframe, const QVector<IPC::Buffer> &buffers);
+    // GOP缓存：向新上线的读取端重放缓存的帧，调用方持有m_WriteMutex
+    bool ReplayGop(IPC::WriteError &error);
+    // GOP缓存：写入一帧，读取端上线后的第一帧单独成一条记录并带上GopStart，调用方持有m_WriteMutex
+    bool WriteGopMessage(const QVector<IPC::Buffer> &buffers, IPC::WriteError &error);
+    // GOP缓存：读取端上线时通知写入端重放，本流在GopStart之前积压的旧帧在读取时丢弃，其它流不受影响
+    void JoinAtKeyframe();
+    // GOP缓存：读取端加入期间是否丢弃本流的这条记录
+    bool IsStaleBeforeGop(const IPCRing::Record *pRecord);
+    // 单块布局：把合并记录拆成单条消息放入m_Unpacked
+    void Unpack(const IPCRing::Record *pRecord);
+    // 遍历合并记录中的每条消息，分段直接指向记录正文；格式错误返回false
+    static bool ForEachCombined(const IPCRing::Record *pRecord, const std::function<void(quint64 stream, const QVector<IPC::Buffer> &segments)> &callback);
+    // 单块布局：设置状态并唤醒对端
+    void SetControlState(char type);
+
+    // 打开唤醒通知
+    bool StartNotifier(IPCNotifier *&pNotifier, const QString &key);
+    // 关闭唤醒通知，remove为true时同时删除命名对象
+    bool StopNotifier(IPCNotifier *&pNotifier, bool remove = false);
+    // 唤醒对端
+    void NotifyPeer();
+    // 本端等待时使用的通知对象
+    IPCNotifier *WakeNotifier();
+    // 双缓冲轮询间隔的休眠，取消时立即返回
+    void InterruptibleSleep(qint32 ms);
+    // 单块布局每次等待的时长
+    qint32 WaitInterval(const QDeadlineTimer &deadline);
 
     // 交互双缓冲区
     void Swap();
@@ -186,6 +539,8 @@ private:
 
     // 标记端类型
     IPC::Type m_Type;
+    // 共享内存布局
+    IPC::Layout m_Layout;
 
     // 标记锁状态
     bool m_IsSharedMemory1Locked;
@@ -199,7 +554,40 @@ private:
     // 心跳包，写两端的时间戳
     QSharedMemory *m_pSharedMemory3;  // 17个字节，起始字节写状态，接下来的8个字节记写入端心跳，末尾8个字节写读取端心跳
 
+    // 单块布局，控制块 + 环形数据区
+    QSharedMemory *m_pSharedMemory0;
+    ControlBlock *m_pControl;
+    IPCRing m_Ring;
+    // 控制通道，事件消息不在视频帧后面排队
+    IPCRing m_ControlRing;
+    // 反向通道，读取端写入、写入端读取
+    IPCRing m_ReverseRing;
+    // 反向通道本端的读写锁
+    std::mutex m_FeedbackMutex;
+    // 数据通道写入锁，保证一条消息的分段连续写入
+    std::mutex m_WriteMutex;
+    // 控制通道写入锁
+    std::mutex m_ControlMutex;
+    // 参数块，紧跟在控制块之后
+    IPCParameterBlock m_Parameters;
+    // 邮箱布局的三缓冲，紧跟在解码器配置之后
+    IPCMailbox m_Mailbox;
+    // 参数块发布锁
+    std::mutex m_ParameterMutex;
+    // 读取端上次采样的参数代数
+    quint64 m_ParameterGeneration;
+    // 解码器配置，紧跟在参数块之后，发布与参数块共用一把锁
+    IPCExtradata m_Extradata;
+    // 读取端已取到的配置版本
+    quint64 m_ExtradataVersion;
+
+    // 唤醒写入端，读取端上线/下线、释放空间时通知
+    IPCNotifier *m_pWriterNotifier;
+    // 唤醒读取端，写入端创建完共享内存、提交数据时通知
+    IPCNotifier *m_pReaderNotifier;
+
     // 共享内存键
+    QString m_MemoryKey0;
     QString m_MemoryKey1;
     QString m_MemoryKey2;
     QString m_MemoryKey3;
@@ -207,9 +595,61 @@ private:
     // 共享内存大小
     qsizetype m_MaxBytes;
 
-    // 正在取消
-    bool m_isCanceling;
+    // 取消令牌
+    IPCCancelToken m_CancelToken;
 
     // 序号
     quint64 m_index;
+
+    // 常驻通道
+    bool m_isPersistent;
+    // 读取端已知的代数
+    quint64 m_Generation;
+
+    // 背压策略，发送线程与设置线程可能不同
+    std::atomic<IPC::Backpressure> m_Backpressure;
+    // 已经开始丢帧，等待下一个I帧；可能在多个发送线程中读写
+    std::atomic<bool> m_isWaitingKeyframe;
+    // 累计丢弃的帧数
+    std::atomic<quint64> m_droppedFrames;
+    // 抽帧计数，只在写入端使用
+    quint64 m_decimationCount;
+    // 因订阅条件累计跳过的消息数
+    std::atomic<quint64> m_filteredMessages;
+
+    // 是否由事件循环监听可读
+    bool m_isWatching;
+
+    // 从合并记录拆出的单条消息
+    struct UnpackedMessage
+    {
+        quint64 stream;
+        QVector<QByteArray> segments;
+    };
+
+    // 写入合并：合并上限、延迟预算(微秒)、已合并的消息及最早一条的计时
+    qint64 m_CombineBytes;
+    qint32 m_CombineBudget;
+    QByteArray m_CombineBuffer;
+    QElapsedTimer m_CombineTimer;
+    // 读取端已拆出但还没读走的消息
+    QQueue<UnpackedMessage> m_Unpacked;
+
+    // GOP缓存：上限、已缓存的帧及字节数、缓存是否从I帧开始完整、写入端已知的读取端上线次数
+    qint64 m_GopBytes;
+    QVector<QVector<QByteArray>> m_Gop;
+    qint64 m_GopCachedBytes;
+    bool m_isGopValid;
+    quint32 m_ReaderEpoch;
+    // GOP缓存：写入端下一帧是否要带上GopStart
+    bool m_isGopStartPending;
+    // GOP缓存：读取端已通知重放、还没读到GopStart
+    bool m_isJoining;
+    // ReadBatch返回的拆出消息，保持到下一次读取
+    QVector<QByteArray> m_BatchHold;
+
+    // 按时间戳节流
+    IPCPacer m_Pacer;
+    // 数据通道消息的有效期(毫秒)，0表示不过期
+    qint32 m_TimeToLive;
 };
@@ -0,0 +1,238 @@
+// self
+#include "jitter.h"
+
+// project
+#include "../logger/logger.h"
+
+// qt
+#include <QtCore/QDeadlineTimer>
+
+// c/c++
+#include <algorithm>
+#include <chrono>
+
+
+
+IPCJitterBuffer::IPCJitterBuffer()
+	: m_Deadline((qint64)DefaultDeadline * 1000)
+	, m_TicksPerSecond(1000)
+	, m_isAnchored(false)
+	, m_OriginTimestamp(0)
+	, m_BaseTransit(0)
+	, m_LastArrival(0)
+	, m_LastTimestamp(0)
+	, m_Jitter(0)
+	, m_skippedFrames(0)
+{
+}
+
+
+void IPCJitterBuffer::Configure(qint32 msDeadline, quint32 ticksPerSecond)
+{
+	m_Deadline = (qint64)qMax(msDeadline, 0) * 1000;
+	m_TicksPerSecond = ticksPerSecond == 0 ? 1000 : ticksPerSecond;
+	m_isAnchored = false;
+}
+
+
+bool IPCJitterBuffer::Receive(IPC &ipc, Response::Message &message, IPC::ReadError &error)
+{
+	while (true) {
+		// 先把已到达的消息全部读进来，落后时才能看到最新的I帧
+		while (m_Frames.isEmpty() || ipc.IsReadable()) {
+			if (!Response::Receive(ipc, message, error)) {
+				return false;
+			}
+
+			if (!Push(message)) {
+				return true;
+			}
+		}
+
+		if (Pop(message)) {
+			error = IPC::ReadError::NoError;
+			return true;
+		}
+
+		// 队首还没到播放时刻，等到期或有新消息到达
+		qint64 wait = WaitTime();
+		if (!ipc.WaitReadable(QDeadlineTimer(wait / 1000 + 1), error)
+			&& error != IPC::ReadError::Timeout) {
+			return false;
+		}
+	}
+}
+
+
+bool IPCJitterBuffer::Push(const Response::Message &message)
+{
+	if (message.control || message.commonHeader.type() != message::CommonHead_Type_Video) {
+		return false;
+	}
+
+	message::VideoHead videoHeader;
+	if (!videoHeader.ParseFromArray(message.extendHeader.constData(), message.extendHeader.size())) {
+		LogWarningC("parse video header fail\n");
+		return false;
+	}
+
+	IPCJitterBuffer::Frame frame;
+	frame.message = message;
+	frame.timestamp = videoHeader.dts() != 0 || videoHeader.pts() == 0 ? videoHeader.dts() : videoHeader.pts();
+	frame.keyframe = videoHeader.type() == message::VideoHead_FrameType_IntraCoded;
+
+	qint64 now = Now();
+
+	// 时间戳回退或跳变说明换了源或跳转，旧的时间基准不再适用
+	quint64 maxGap = (quint64)MaxGapSeconds * m_TicksPerSecond;
+	if (m_isAnchored && (frame.timestamp + maxGap < m_LastTimestamp || frame.timestamp > m_LastTimestamp + maxGap)) {
+		// 旧时间线上的帧不能和新时间戳一起排序，向后跳转时会排到新帧后面被迟放；跳转之后这些帧也不再需要
+		LogInfo() << QString("jitter buffer timestamp discontinuity, last: %1, current: %2, flushed: %3\n")
+			.arg(m_LastTimestamp).arg(frame.timestamp).arg(m_Frames.size());
+		m_skippedFrames += m_Frames.size();
+		m_Frames.clear();
+		m_isAnchored = false;
+	}
+
+	if (!m_isAnchored) {
+		m_isAnchored = true;
+		m_OriginTimestamp = frame.timestamp;
+		m_BaseTransit = now;
+		m_LastArrival = now;
+		m_LastTimestamp = frame.timestamp;
+		m_Jitter = 0;
+	}
+	else {
+		// 到达间隔与时间戳间隔之差，按1/16平滑
+		qint64 difference = (now - m_LastArrival) - (TimestampToTime(frame.timestamp) - TimestampToTime(m_LastTimestamp));
+		m_Jitter += (qAbs(difference) - m_Jitter) / 16;
+		m_LastArrival = now;
+		m_LastTimestamp = frame.timestamp;
+
+		// 传输延迟取最小值作为基准，到得最早的帧最接近写入端的节奏
+		m_BaseTransit = qMin(m_BaseTransit, now - TimestampToTime(frame.timestamp));
+	}
+
+	// 通常按到达顺序已经有序，从尾部找插入位置；时间戳相同时保持到达顺序
+	auto position = std::upper_bound(m_Frames.begin(), m_Frames.end(), frame.timestamp,
+		[](quint64 timestamp, const IPCJitterBuffer::Frame &other) { return timestamp < other.timestamp; });
+	m_Frames.insert(position, frame);
+
+	return true;
+}
+
+
+bool IPCJitterBuffer::Pop(Response::Message &message)
+{
+	if (m_Frames.isEmpty()) {
+		return false;
+	}
+
+	qint64 now = Now();
+	SkipToKeyframe(now);
+
+	if (DueTime(m_Frames.first()) > now) {
+		return false;
+	}
+
+	return Take(message);
+}
+
+
+bool IPCJitterBuffer::Take(Response::Message &message)
+{
+	if (m_Frames.isEmpty()) {
+		return false;
+	}
+
+	message = m_Frames.takeFirst().message;
+
+	return true;
+}
+
+
+qint64 IPCJitterBuffer::WaitTime()
+{
+	if (m_Frames.isEmpty()) {
+		return -1;
+	}
+
+	return qMax<qint64>(DueTime(m_Frames.first()) - Now(), 0);
+}
+
+
+qint64 IPCJitterBuffer::Jitter()
+{
+	return m_Jitter;
+}
+
+
+quint64 IPCJitterBuffer::SkippedFrames()
+{
+	return m_skippedFrames;
+}
+
+
+qsizetype IPCJitterBuffer::Size()
+{
+	return m_Frames.size();
+}
+
+
+void IPCJitterBuffer::Clear()
+{
+	m_Frames.clear();
+	m_isAnchored = false;
+}
+
+
+qint64 IPCJitterBuffer::TimestampToTime(quint64 timestamp)
+{
+	// 相对第一帧换算，避免大时间戳乘以一百万后溢出
+	double ticks = timestamp >= m_OriginTimestamp ? (double)(timestamp - m_OriginTimestamp) : -(double)(m_OriginTimestamp - timestamp);
+	return (qint64)(ticks * 1000000.0 / m_TicksPerSecond);
+}
+
+
+qint64 IPCJitterBuffer::DueTime(const IPCJitterBuffer::Frame &frame)
+{
+	return TimestampToTime(frame.timestamp) + m_BaseTransit + 2 * m_Jitter;
+}
+
+
+void IPCJitterBuffer::SkipToKeyframe(qint64 now)
+{
+	if (now - DueTime(m_Frames.first()) <= m_Deadline) {
+		return;
+	}
+
+	// 只能跳到I帧，否则解码器拿到的是缺参考帧的P/B帧；队首之后没有I帧时照常播放，等下一个I帧到达
+	qsizetype keyframe = -1;
+	for (qsizetype i = m_Frames.size() - 1; i > 0; i--) {
+		if (m_Frames.at(i).keyframe) {
+			keyframe = i;
+			break;
+		}
+	}
+
+	if (keyframe < 0) {
+		return;
+	}
+
+	m_Frames.remove(0, keyframe);
+	m_skippedFrames += keyframe;
+
+	// 跳过之后仍然落后，说明写入端自己慢于实时(暂停、卡顿)，以这一帧重新建立基准
+	qint64 lag = now - DueTime(m_Frames.first());
+	if (lag > m_Deadline) {
+		m_BaseTransit += lag;
+	}
+
+	LogInfo() << QString("jitter buffer behind deadline, skipped: %1, total: %2\n").arg(keyframe).arg(m_skippedFrames);
+}
+
+
+qint64 IPCJitterBuffer::Now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+// project
+#include "response.h"
+
+// qt
+#include <QtCore/QVector>
+
+
+
+// 读取端的抖动缓冲，只缓冲视频帧
+// 按时间戳排序，按到达间隔与时间戳间隔之差估计抖动，队首帧到播放时刻才交付，吸收到达时间的抖动
+// 播放时刻 = 时间戳 + 最小传输延迟 + 两倍抖动；读取端卡顿后队首落后超过deadline时，跳到缓冲中最新的I帧，保持在直播的最新位置
+// 时间戳取dts，没有dts时取pts，与写入端节流一致；帧按解码顺序交付，B帧不会被按pts重排
+class IPCJitterBuffer
+{
+public:
+    // 默认落后多少毫秒时跳帧
+    static const qint32 DefaultDeadline = 500;
+    // 时间戳跳变超过这么多秒视为不连续，重新建立时间基准
+    static const qint32 MaxGapSeconds = 10;
+
+    // 缓冲的一帧
+    struct Frame
+    {
+        Response::Message message;
+        // 排序和计时用的时间戳
+        quint64 timestamp;
+        // 是否是I帧
+        bool keyframe;
+    };
+
+
+public:
+    IPCJitterBuffer();
+
+    // msDeadline为允许落后的毫秒数，ticksPerSecond为时间戳的单位，如毫秒为1000、MPEG-TS为90000
+    void Configure(qint32 msDeadline, quint32 ticksPerSecond = 1000);
+
+    // 接收下一条消息：先把已到达的消息全部读进缓冲，再交付到期的队首帧；非视频消息不进缓冲，读到即交付
+    bool Receive(IPC &ipc, Response::Message &message, IPC::ReadError &error);
+
+    // 放入一条视频消息，不是视频消息或扩展头解析失败返回false；时间戳不连续时清掉旧时间线上的帧，计入跳过的帧数
+    bool Push(const Response::Message &message);
+    // 取出到期的队首帧，落后超过deadline时先跳到最新的I帧；没有到期的帧返回false
+    bool Pop(Response::Message &message);
+    // 不论是否到期取出队首帧，写入端退出后取完剩余的帧
+    bool Take(Response::Message &message);
+    // 距离队首帧到期的微秒数，已到期为0，缓冲为空为-1
+    qint64 WaitTime();
+
+    // 当前抖动估计(微秒)
+    qint64 Jitter();
+    // 累计跳过的帧数
+    quint64 SkippedFrames();
+    // 缓冲中的帧数
+    qsizetype Size();
+    // 清空缓冲并丢掉时间基准，跳转或写入端重启后调用
+    void Clear();
+
+
+private:
+    // 时间戳换算成相对第一帧的微秒数
+    qint64 TimestampToTime(quint64 timestamp);
+    // 帧的播放时刻
+    qint64 DueTime(const IPCJitterBuffer::Frame &frame);
+    // 队首落后超过deadline时丢到最新的I帧
+    void SkipToKeyframe(qint64 now);
+    // 单调时钟(微秒)
+    static qint64 Now();
+
+    // 允许落后的微秒数
+    qint64 m_Deadline;
+    // 时间戳单位
+    quint32 m_TicksPerSecond;
+
+    // 按时间戳排序的帧
+    QVector<IPCJitterBuffer::Frame> m_Frames;
+
+    // 时间基准：第一帧的时间戳、观察到的最小传输延迟(到达时刻 - 时间戳)
+    bool m_isAnchored;
+    quint64 m_OriginTimestamp;
+    qint64 m_BaseTransit;
+    // 上一帧的到达时刻和时间戳，用于估计抖动
+    qint64 m_LastArrival;
+    quint64 m_LastTimestamp;
+    // 抖动估计(微秒)
+    qint64 m_Jitter;
+
+    // 累计跳过的帧数
+    quint64 m_skippedFrames;
+};
@@ -0,0 +1,125 @@
+// self
+#include "mailbox.h"
+
+// c/c++
+#include <new>
+
+
+
+IPCMailbox::IPCMailbox()
+	: m_pHeader(nullptr)
+	, m_pSlots(nullptr)
+	, m_sequence(0)
+{
+}
+
+
+qsizetype IPCMailbox::Bytes(qsizetype capacity)
+{
+	return sizeof(Header) + (sizeof(Slot) + ((capacity + 7) & ~7)) * SlotCount;
+}
+
+
+void IPCMailbox::Format(void *address, qsizetype capacity)
+{
+	m_pHeader = new (address) Header();
+	m_pHeader->latest.store(0, std::memory_order_relaxed);
+	m_pHeader->writerSlot.store(1, std::memory_order_relaxed);
+	m_pHeader->readerSlot.store(2, std::memory_order_relaxed);
+	m_pHeader->capacity = (capacity + 7) & ~7;
+	m_pSlots = (char *)address + sizeof(Header);
+
+	for (quint32 i = 0; i < SlotCount; i++) {
+		At(i)->sequence = 0;
+		At(i)->size = 0;
+	}
+
+	m_sequence = 0;
+}
+
+
+void IPCMailbox::Attach(void *address)
+{
+	m_pHeader = (Header *)address;
+	m_pSlots = (char *)address + sizeof(Header);
+
+	// 接管时从已发布的最大序号继续
+	m_sequence = 0;
+	for (quint32 i = 0; i < SlotCount; i++) {
+		m_sequence = qMax(m_sequence, At(i)->sequence);
+	}
+}
+
+
+void IPCMailbox::Detach()
+{
+	m_pHeader = nullptr;
+	m_pSlots = nullptr;
+}
+
+
+bool IPCMailbox::IsAttached()
+{
+	return m_pHeader != nullptr;
+}
+
+
+qsizetype IPCMailbox::Capacity()
+{
+	return m_pHeader->capacity;
+}
+
+
+char *IPCMailbox::Back()
+{
+	return (char *)At(m_pHeader->writerSlot.load(std::memory_order_relaxed)) + sizeof(Slot);
+}
+
+
+void IPCMailbox::Publish(qsizetype size)
+{
+	quint32 back = m_pHeader->writerSlot.load(std::memory_order_relaxed);
+	Slot *pSlot = At(back);
+	pSlot->sequence = ++m_sequence;
+	pSlot->size = size;
+
+	// 交换出来的槽要么是读取端没来得及取的旧消息，要么是读取端刚放回的槽，都可以覆盖
+	quint32 previous = m_pHeader->latest.exchange(back | Fresh, std::memory_order_acq_rel);
+	m_pHeader->writerSlot.store(previous & ~Fresh, std::memory_order_relaxed);
+}
+
+
+bool IPCMailbox::Acquire()
+{
+	if (!HasFresh()) {
+		return false;
+	}
+
+	quint32 front = m_pHeader->readerSlot.load(std::memory_order_relaxed);
+	quint32 previous = m_pHeader->latest.exchange(front, std::memory_order_acq_rel);
+	m_pHeader->readerSlot.store(previous & ~Fresh, std::memory_order_relaxed);
+
+	return true;
+}
+
+
+bool IPCMailbox::HasFresh()
+{
+	return (m_pHeader->latest.load(std::memory_order_acquire) & Fresh) != 0;
+}
+
+
+const char *IPCMailbox::Front(qsizetype &size, quint64 &sequence)
+{
+	Slot *pSlot = At(m_pHeader->readerSlot.load(std::memory_order_relaxed));
+	size = pSlot->size;
+	sequence = pSlot->sequence;
+
+	return (const char *)pSlot + sizeof(Slot);
+}
+
+
+IPCMailbox::Slot *IPCMailbox::At(quint32 slot)
+{
+	return (Slot *)(m_pSlots + (sizeof(Slot) + m_pHeader->capacity) * slot);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+// qt
+#include <QtCore/QtGlobal>
+
+// c/c++
+#include <atomic>
+
+
+
+// 位于共享内存中的三缓冲邮箱，只保留最新的一条消息
+// 三个槽分别归写入端、读取端和“最新”所有：写入端写完自己的槽后与“最新”交换，读取端有新消息时再与“最新”交换
+// 双方都不等待对方，读取端跟不上时中间的消息直接被覆盖
+class IPCMailbox
+{
+public:
+    // 槽的数量
+    static const quint32 SlotCount = 3;
+    // latest中表示“最新”槽尚未被读取端取走的标志位，低位是槽号
+    static const quint32 Fresh = 1u << 31;
+
+    // 邮箱头部
+    struct Header
+    {
+        // “最新”槽号及Fresh标志，双方都会修改
+        alignas(64) std::atomic<quint32> latest;
+        // 写入端正在写的槽号，只由写入端修改，常驻通道接管时恢复
+        alignas(64) std::atomic<quint32> writerSlot;
+        // 读取端持有的槽号，只由读取端修改，读取端重新挂载时恢复
+        alignas(64) std::atomic<quint32> readerSlot;
+        // 每个槽的容量
+        quint64 capacity;
+    };
+
+    // 槽头
+    struct Slot
+    {
+        // 写入端发布的序号，从1开始
+        quint64 sequence;
+        // 消息大小
+        quint64 size;
+    };
+
+
+public:
+    IPCMailbox();
+
+    // 每个槽容量为capacity时需要的共享内存字节数
+    static qsizetype Bytes(qsizetype capacity);
+
+    // 写入端创建共享内存后初始化
+    void Format(void *address, qsizetype capacity);
+    // 读取端挂载或写入端接管共享内存后映射
+    void Attach(void *address);
+    // 解除映射
+    void Detach();
+    // 是否已映射
+    bool IsAttached();
+    // 每个槽的容量
+    qsizetype Capacity();
+
+    // 写入端：当前可写的槽，写完调用Publish
+    char *Back();
+    // 写入端：发布写好的size字节，成为“最新”，被替换下来的槽留给下一次写入
+    void Publish(qsizetype size);
+
+    // 读取端：有新消息时取走，返回true；没有新消息时保持上次取到的内容
+    bool Acquire();
+    // 读取端：是否有尚未取走的新消息，不取
+    bool HasFresh();
+    // 读取端：当前持有的消息，sequence为0表示还没有取到过
+    const char *Front(qsizetype &size, quint64 &sequence);
+
+
+private:
+    // 槽头地址
+    Slot *At(quint32 slot);
+
+    // 共享内存中的头部
+    Header *m_pHeader;
+    // 第一个槽
+    char *m_pSlots;
+
+    // 写入端本地的发布序号
+    quint64 m_sequence;
+};
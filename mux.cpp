@@ -0,0 +1,318 @@
+// self
+#include "mux.h"
+
+// project
+#include "../logger/logger.h"
+
+
+
+IPCMux::IPCMux(IPC &ipc)
+	: m_ipc(ipc)
+	, m_Cursor(0)
+	, m_isVisiting(false)
+	, m_QueueLimit(DefaultQueueLimit)
+	, m_isRunning(false)
+{
+}
+
+
+IPCMux::~IPCMux()
+{
+	Stop();
+}
+
+
+void IPCMux::Start()
+{
+	std::lock_guard<std::mutex> locker(m_Mutex);
+	if (m_isRunning) {
+		return;
+	}
+
+	m_isRunning = true;
+	m_Thread = std::thread(&IPCMux::Run, this);
+}
+
+
+void IPCMux::Stop()
+{
+	{
+		std::lock_guard<std::mutex> locker(m_Mutex);
+		if (!m_isRunning) {
+			return;
+		}
+
+		m_isRunning = false;
+		m_Streams.clear();
+		m_Order.clear();
+		m_Cursor = 0;
+		m_isVisiting = false;
+	}
+
+	m_Readable.notify_all();
+	m_Writable.notify_all();
+
+	// 发送线程可能阻塞在共享内存写入上，须先取消ipc或等读取端释放空间
+	if (m_Thread.joinable()) {
+		m_Thread.join();
+	}
+}
+
+
+void IPCMux::SetWeight(quint64 stream, quint32 weight)
+{
+	std::lock_guard<std::mutex> locker(m_Mutex);
+
+	if (!m_Streams.contains(stream)) {
+		m_Streams.insert(stream, { 1, 0, {} });
+		m_Order.append(stream);
+	}
+
+	m_Streams[stream].weight = qMax<quint32>(weight, 1);
+}
+
+
+void IPCMux::SetQueueLimit(qsizetype limit)
+{
+	std::lock_guard<std::mutex> locker(m_Mutex);
+	m_QueueLimit = qMax<qsizetype>(limit, 1);
+}
+
+
+void IPCMux::RemoveStream(quint64 stream)
+{
+	{
+		std::lock_guard<std::mutex> locker(m_Mutex);
+
+		m_Streams.remove(stream);
+		m_Order.removeAll(stream);
+		m_Cursor = 0;
+		m_isVisiting = false;
+	}
+
+	m_Writable.notify_all();
+}
+
+
+bool IPCMux::Write(quint64 stream, const QVector<IPC::Buffer> &buffers, IPC::WriteError &error)
+{
+	if (stream > IPCRing::MaxStream) {
+		error = IPC::WriteError::Stopped;
+		return false;
+	}
+
+	// 锁外拷贝，发送线程写共享内存时不持有队列锁
+	QVector<QByteArray> message;
+	message.reserve(buffers.size());
+	for (const IPC::Buffer &buffer : buffers) {
+		message.append(QByteArray(buffer.pData, buffer.nbytes));
+	}
+
+	std::unique_lock<std::mutex> locker(m_Mutex);
+
+	if (!m_Streams.contains(stream)) {
+		m_Streams.insert(stream, { 1, 0, {} });
+		m_Order.append(stream);
+	}
+
+	m_Writable.wait(locker, [this, stream]() {
+		return !m_isRunning || m_ipc.IsCanceling() || !m_Streams.contains(stream) || m_Streams[stream].messages.size() < m_QueueLimit;
+	});
+
+	if (!m_isRunning) {
+		error = IPC::WriteError::Stopped;
+		return false;
+	}
+
+	if (m_ipc.IsCanceling() || !m_Streams.contains(stream)) {
+		error = IPC::WriteError::Canceling;
+		return false;
+	}
+
+	m_Streams[stream].messages.enqueue(message);
+	locker.unlock();
+
+	m_Readable.notify_one();
+
+	error = IPC::WriteError::NoError;
+
+	return true;
+}
+
+
+void IPCMux::Run()
+{
+	quint64 stream = 0;
+	QVector<QByteArray> message;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> locker(m_Mutex);
+			m_Readable.wait(locker, [this, &stream, &message]() {
+				return !m_isRunning || Next(stream, message);
+			});
+
+			if (!m_isRunning) {
+				break;
+			}
+		}
+
+		m_Writable.notify_all();
+
+		QVector<IPC::Buffer> buffers;
+		buffers.reserve(message.size());
+		for (const QByteArray &segment : message) {
+			buffers.append({ segment.constData(), segment.size() });
+		}
+
+		// 共享内存空间不足时在这里阻塞，期间各流继续排队，空出来后仍按权重轮询
+		IPC::WriteError error;
+		if (!m_ipc.WriteStream(stream, buffers, error)) {
+			LogWarning() << QString("mux write fail, stream: %1, error: %2\n").arg(stream).arg((qint32)error);
+		}
+	}
+}
+
+
+bool IPCMux::Next(quint64 &stream, QVector<QByteArray> &message)
+{
+	// 差额轮询：每轮到一个流按权重增加一次额度，额度够发队首消息就发，不够换下一个流，额度留到下一轮
+	qsizetype idle = 0;
+	while (!m_Order.isEmpty() && idle < m_Order.size()) {
+		if (m_Cursor >= m_Order.size()) {
+			m_Cursor = 0;
+		}
+
+		Stream &current = m_Streams[m_Order[m_Cursor]];
+		if (!current.messages.isEmpty()) {
+			idle = 0;
+
+			if (!m_isVisiting) {
+				current.deficit += Quantum * current.weight;
+				m_isVisiting = true;
+			}
+
+			qint64 nbytes = MessageBytes(current.messages.head());
+			if (nbytes <= current.deficit) {
+				current.deficit -= nbytes;
+				stream = m_Order[m_Cursor];
+				message = current.messages.dequeue();
+
+				// 队列空了不保留额度，避免空闲的流攒下额度之后突发
+				if (current.messages.isEmpty()) {
+					current.deficit = 0;
+				}
+
+				return true;
+			}
+		}
+		else {
+			current.deficit = 0;
+			idle++;
+		}
+
+		m_isVisiting = false;
+		m_Cursor++;
+	}
+
+	return false;
+}
+
+
+qint64 IPCMux::MessageBytes(const QVector<QByteArray> &message)
+{
+	qint64 nbytes = 0;
+	for (const QByteArray &segment : message) {
+		nbytes += segment.size();
+	}
+
+	return nbytes;
+}
+
+
+IPCDemux::IPCDemux(IPC &ipc)
+	: m_ipc(ipc)
+	, m_QueueLimit(IPCMux::DefaultQueueLimit)
+	, m_droppedMessages(0)
+{
+}
+
+
+void IPCDemux::SetCallback(quint64 stream, const Callback &callback)
+{
+	std::lock_guard<std::mutex> locker(m_Mutex);
+
+	if (callback) {
+		m_Callbacks.insert(stream, callback);
+	}
+	else {
+		m_Callbacks.remove(stream);
+	}
+}
+
+
+void IPCDemux::SetQueueLimit(qsizetype limit)
+{
+	std::lock_guard<std::mutex> locker(m_Mutex);
+	m_QueueLimit = qMax<qsizetype>(limit, 1);
+}
+
+
+bool IPCDemux::Dispatch(IPC::ReadError &error)
+{
+	QByteArray message;
+	quint64 stream = 0;
+	if (!m_ipc.ReadMessage(message, stream, error)) {
+		return false;
+	}
+
+	Callback callback;
+	{
+		std::lock_guard<std::mutex> locker(m_Mutex);
+
+		callback = m_Callbacks.value(stream);
+		if (!callback) {
+			QQueue<QByteArray> &queue = m_Queues[stream];
+			if (queue.size() >= m_QueueLimit) {
+				queue.dequeue();
+				m_droppedMessages++;
+			}
+
+			queue.enqueue(message);
+			return true;
+		}
+	}
+
+	// 回调不持锁，回调里可以调整回调和队列
+	callback(stream, message);
+
+	return true;
+}
+
+
+bool IPCDemux::Take(quint64 stream, QByteArray &message)
+{
+	std::lock_guard<std::mutex> locker(m_Mutex);
+
+	if (!m_Queues.contains(stream) || m_Queues[stream].isEmpty()) {
+		return false;
+	}
+
+	message = m_Queues[stream].dequeue();
+
+	return true;
+}
+
+
+qsizetype IPCDemux::Pending(quint64 stream)
+{
+	std::lock_guard<std::mutex> locker(m_Mutex);
+	return m_Queues.contains(stream) ? m_Queues[stream].size() : 0;
+}
+
+
+quint64 IPCDemux::DroppedMessages()
+{
+	std::lock_guard<std::mutex> locker(m_Mutex);
+	return m_droppedMessages;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+// project
+#include "ipc.h"
+
+// qt
+#include <QtCore/QHash>
+#include <QtCore/QQueue>
+
+// c/c++
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+
+
+// 多路复用写入端，多个逻辑流共用一个单块布局通道
+// 每个流有自己的队列，由发送线程按加权轮询(差额轮询)写入共享内存，繁忙的流不会饿死其它流
+class IPCMux
+{
+public:
+    // 每一轮按权重获得的字节数
+    static const qint64 Quantum = 64 * 1024;
+    // 每个流默认最多排队的消息数
+    static const qsizetype DefaultQueueLimit = 8;
+
+    // ipc须以单块布局开启写入端
+    explicit IPCMux(IPC &ipc);
+    ~IPCMux();
+
+    // 启动发送线程
+    void Start();
+    // 停止发送线程，队列中未发送的消息丢弃
+    void Stop();
+
+    // 设置流的权重，默认为1，权重越大分到的带宽越多
+    void SetWeight(quint64 stream, quint32 weight);
+    // 设置每个流最多排队的消息数
+    void SetQueueLimit(qsizetype limit);
+    // 移除流，队列中未发送的消息丢弃
+    void RemoveStream(quint64 stream);
+
+    // 写入一条消息，拷贝进该流的队列后返回；队列已满时阻塞，直到发送线程取走或停止
+    bool Write(quint64 stream, const QVector<IPC::Buffer> &buffers, IPC::WriteError &error);
+
+
+private:
+    // 逻辑流
+    struct Stream
+    {
+        // 权重
+        quint32 weight;
+        // 本轮剩余可发送的字节数
+        qint64 deficit;
+        // 待发送的消息，每条消息按分段保存
+        QQueue<QVector<QByteArray>> messages;
+    };
+
+    // 发送线程
+    void Run();
+    // 按差额轮询取下一条待发送的消息，没有则返回false
+    bool Next(quint64 &stream, QVector<QByteArray> &message);
+    // 一条消息的字节数
+    static qint64 MessageBytes(const QVector<QByteArray> &message);
+
+    IPC &m_ipc;
+
+    std::mutex m_Mutex;
+    // 有新消息
+    std::condition_variable m_Readable;
+    // 队列有空位
+    std::condition_variable m_Writable;
+
+    QHash<quint64, Stream> m_Streams;
+    // 轮询顺序
+    QVector<quint64> m_Order;
+    // 轮询位置
+    qsizetype m_Cursor;
+    // 当前流本轮是否已增加过额度
+    bool m_isVisiting;
+    qsizetype m_QueueLimit;
+
+    std::thread m_Thread;
+    bool m_isRunning;
+};
+
+
+// 多路复用读取端，按流编号把消息分发到回调或各自的队列
+class IPCDemux
+{
+public:
+    // 回调在分发线程中执行，消息格式同数据通道：消息头大小 + 消息头 + 扩展头 + 消息体
+    using Callback = std::function<void(quint64 stream, const QByteArray &message)>;
+
+    // ipc须以单块布局开启读取端
+    explicit IPCDemux(IPC &ipc);
+
+    // 设置流的回调，设置后该流的消息不再进入队列；callback为空时取消
+    void SetCallback(quint64 stream, const Callback &callback);
+    // 设置每个流队列最多保存的消息数，超过时丢弃最旧的消息
+    void SetQueueLimit(qsizetype limit);
+
+    // 读取一条消息并分发，没有数据时阻塞；控制通道有消息时返回false，错误为ControlPending
+    bool Dispatch(IPC::ReadError &error);
+    // 取出流队列中最早的一条消息，不阻塞
+    bool Take(quint64 stream, QByteArray &message);
+    // 流队列中的消息数
+    qsizetype Pending(quint64 stream);
+    // 因队列已满丢弃的消息数
+    quint64 DroppedMessages();
+
+
+private:
+    IPC &m_ipc;
+
+    std::mutex m_Mutex;
+    QHash<quint64, Callback> m_Callbacks;
+    QHash<quint64, QQueue<QByteArray>> m_Queues;
+    qsizetype m_QueueLimit;
+    quint64 m_droppedMessages;
+};
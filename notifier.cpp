@@ -0,0 +1,259 @@
+// self
+#include "notifier.h"
+
+// project
+#include "../logger/logger.h"
+
+// qt
+#include <QtCore/QDir>
+#include <QtCore/QThread>
+
+#if defined(Q_OS_WIN)
+// windows
+#include <Windows.h>
+#else
+// c/c++
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+
+IPCNotifier::IPCNotifier()
+#if defined(Q_OS_WIN)
+	: m_hEvent(nullptr)
+	, m_hInterrupt(nullptr)
+#else
+	: m_fd(-1)
+	, m_interruptFd(-1)
+#endif
+{
+}
+
+
+IPCNotifier::~IPCNotifier()
+{
+	Close();
+}
+
+
+bool IPCNotifier::Open(const QString &key)
+{
+	Close();
+
+#if defined(Q_OS_WIN)
+	m_hEvent = CreateEventW(nullptr, FALSE, FALSE, (LPCWSTR)key.utf16());
+	m_hInterrupt = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+#else
+	// 命名管道放在临时目录，与QSharedMemory的键文件保持一致
+	m_Path = QString("%1/%2.fifo").arg(QDir::tempPath()).arg(key).toLocal8Bit();
+	if (mkfifo(m_Path.constData(), 0666) != 0 && errno != EEXIST) {
+		LogWarning() << QString("mkfifo fail, path: %1, errno: %2\n").arg(m_Path.constData()).arg(errno);
+	}
+
+	// 以读写方式打开，不会因为对端尚未打开而阻塞，写入的通知在对端打开前也不会丢失
+	m_fd = open(m_Path.constData(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	m_interruptFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+
+	if (!IsOpen()) {
+		LogWarning() << QString("open notifier fail, key: %1\n").arg(key);
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+
+void IPCNotifier::Close()
+{
+#if defined(Q_OS_WIN)
+	if (m_hEvent != nullptr) {
+		CloseHandle(m_hEvent);
+		m_hEvent = nullptr;
+	}
+
+	if (m_hInterrupt != nullptr) {
+		CloseHandle(m_hInterrupt);
+		m_hInterrupt = nullptr;
+	}
+#else
+	if (m_fd >= 0) {
+		close(m_fd);
+		m_fd = -1;
+	}
+
+	if (m_interruptFd >= 0) {
+		close(m_interruptFd);
+		m_interruptFd = -1;
+	}
+#endif
+}
+
+
+void IPCNotifier::Remove()
+{
+#if !defined(Q_OS_WIN)
+	if (!m_Path.isEmpty() && unlink(m_Path.constData()) != 0 && errno != ENOENT) {
+		LogWarning() << QString("unlink fifo fail, path: %1, errno: %2\n").arg(m_Path.constData()).arg(errno);
+	}
+#endif
+}
+
+
+bool IPCNotifier::Refresh()
+{
+#if defined(Q_OS_WIN)
+	return false;
+#else
+	if (m_fd < 0 || m_Path.isEmpty()) {
+		return false;
+	}
+
+	// 路径仍指向已打开的管道，无需重新打开
+	struct stat opened = {};
+	struct stat current = {};
+	if (fstat(m_fd, &opened) == 0 && stat(m_Path.constData(), &current) == 0
+		&& opened.st_dev == current.st_dev && opened.st_ino == current.st_ino) {
+		return false;
+	}
+
+	// 文件不在时重新创建，之后的写入端打开的是同一个管道；打断描述符不变，取消状态不丢失
+	if (mkfifo(m_Path.constData(), 0666) != 0 && errno != EEXIST) {
+		LogWarning() << QString("mkfifo fail, path: %1, errno: %2\n").arg(m_Path.constData()).arg(errno);
+	}
+
+	int fd = open(m_Path.constData(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		LogWarning() << QString("reopen fifo fail, path: %1, errno: %2\n").arg(m_Path.constData()).arg(errno);
+		return false;
+	}
+
+	close(m_fd);
+	m_fd = fd;
+
+	return true;
+#endif
+}
+
+
+bool IPCNotifier::IsOpen()
+{
+#if defined(Q_OS_WIN)
+	return m_hEvent != nullptr && m_hInterrupt != nullptr;
+#else
+	return m_fd >= 0 && m_interruptFd >= 0;
+#endif
+}
+
+
+void IPCNotifier::Notify()
+{
+	if (!IsOpen()) {
+		return;
+	}
+
+#if defined(Q_OS_WIN)
+	SetEvent(m_hEvent);
+#else
+	// 管道写满说明对端还有未处理的通知，忽略EAGAIN即可
+	char c = 1;
+	ssize_t n = write(m_fd, &c, 1);
+	Q_UNUSED(n);
+#endif
+}
+
+
+bool IPCNotifier::Wait(qint32 msTimeout)
+{
+	// 通知对象打开失败时退化为定时轮询
+	if (!IsOpen()) {
+		QThread::msleep(msTimeout < 0 || msTimeout > 40 ? 40 : msTimeout);
+		return false;
+	}
+
+#if defined(Q_OS_WIN)
+	HANDLE handles[2] = { m_hInterrupt, m_hEvent };
+	DWORD ret = WaitForMultipleObjects(2, handles, FALSE, msTimeout < 0 ? INFINITE : (DWORD)msTimeout);
+	return ret == WAIT_OBJECT_0 + 1;
+#else
+	struct pollfd fds[2] = {
+		{ m_interruptFd, POLLIN, 0 },
+		{ m_fd, POLLIN, 0 },
+	};
+
+	int ret = 0;
+	do {
+		ret = poll(fds, 2, msTimeout);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret <= 0 || (fds[0].revents & POLLIN)) {
+		return false;
+	}
+
+	Drain();
+
+	return true;
+#endif
+}
+
+
+void IPCNotifier::Interrupt()
+{
+	if (!IsOpen()) {
+		return;
+	}
+
+#if defined(Q_OS_WIN)
+	SetEvent(m_hInterrupt);
+#else
+	eventfd_write(m_interruptFd, 1);
+#endif
+}
+
+
+void IPCNotifier::ResetInterrupt()
+{
+	if (!IsOpen()) {
+		return;
+	}
+
+#if defined(Q_OS_WIN)
+	ResetEvent(m_hInterrupt);
+#else
+	eventfd_t value = 0;
+	eventfd_read(m_interruptFd, &value);
+#endif
+}
+
+
+qintptr IPCNotifier::Handle()
+{
+	if (!IsOpen()) {
+		return -1;
+	}
+
+#if defined(Q_OS_WIN)
+	return (qintptr)m_hEvent;
+#else
+	return m_fd;
+#endif
+}
+
+
+void IPCNotifier::Drain()
+{
+#if !defined(Q_OS_WIN)
+	// 一次唤醒消费掉所有积压的通知；Windows 下自动复位事件被等待到时已经复位
+	if (m_fd >= 0) {
+		char buffer[64];
+		while (read(m_fd, buffer, sizeof(buffer)) > 0) {
+		}
+	}
+#endif
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+// qt
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+
+
+// 跨进程唤醒通知
+// Windows 下为命名自动复位事件，其它平台为命名管道(FIFO)，两端按同一个键打开同一个对象
+// 命名管道位于QDir::tempPath()/<key>.fifo，IPC的键为<前缀>_<通道键>_writer/_reader；文件不随关闭删除，由创建共享内存的写入端在终止时调用Remove删除；常驻通道的键固定，文件保留给重启后的写入端复用
+// 先于旧写入端终止打开的一端仍持有被删除的旧管道，等待前调用Refresh换到新管道
+class IPCNotifier
+{
+public:
+    IPCNotifier();
+    ~IPCNotifier();
+
+    // 打开通知对象，不存在则创建
+    bool Open(const QString &key);
+    // 关闭通知对象
+    void Close();
+    // 删除命名管道文件，已打开的两端仍可继续使用，之后按同一个键打开的是新对象；Windows 下命名事件随最后一个句柄关闭自动销毁，无需删除
+    void Remove();
+    // 命名管道文件已被删除或替换时重新打开，返回是否换了管道；之前取得的Handle随之失效。Windows 下不需要，总是返回false
+    bool Refresh();
+    // 是否已打开
+    bool IsOpen();
+
+    // 唤醒等待在该对象上的对端
+    void Notify();
+    // 等待被唤醒，被唤醒返回true，超时或被打断返回false；msTimeout < 0 表示一直等待
+    bool Wait(qint32 msTimeout);
+
+    // 打断本进程内正在等待的线程，直到ResetInterrupt之前的等待都会立即返回
+    void Interrupt();
+    // 清除打断状态
+    void ResetInterrupt();
+
+    // 原生句柄，供事件循环监听：Windows 下为事件句柄，其它平台为管道描述符；未打开时为-1
+    qintptr Handle();
+    // 事件循环报告可读后，消费掉积压的通知
+    void Drain();
+
+
+private:
+#if defined(Q_OS_WIN)
+    // 命名事件
+    void *m_hEvent;
+    // 本进程内的打断事件，手动复位
+    void *m_hInterrupt;
+#else
+    // 命名管道及其路径
+    int m_fd;
+    QByteArray m_Path;
+    // 本进程内的打断通知
+    int m_interruptFd;
+#endif
+};
@@ -0,0 +1,142 @@
+// self
+#include "pacer.h"
+
+// c/c++
+#include <chrono>
+#include <cmath>
+
+
+
+IPCPacer::IPCPacer()
+	: m_Lead(-1)
+	, m_TicksPerSecond(1000)
+	, m_Rate(1.0)
+	, m_isAnchored(false)
+	, m_AnchorTimestamp(0)
+	, m_AnchorTime(0)
+	, m_LastTimestamp(0)
+{
+}
+
+
+void IPCPacer::Configure(qint32 msLead, quint32 ticksPerSecond)
+{
+	std::lock_guard<std::mutex> locker(m_Mutex);
+	m_Lead = msLead < 0 ? -1 : (qint64)msLead * 1000;
+	m_TicksPerSecond = ticksPerSecond == 0 ? 1000 : ticksPerSecond;
+	m_isAnchored = false;
+
+	// 关闭时正在等待的帧立即放行
+	m_Condition.notify_all();
+}
+
+
+bool IPCPacer::IsEnabled()
+{
+	return m_Lead.load(std::memory_order_relaxed) >= 0;
+}
+
+
+void IPCPacer::SetSpeed(qint32 speed)
+{
+	std::lock_guard<std::mutex> locker(m_Mutex);
+
+	// 以上一帧的放行时刻为新起点，之后的帧按新倍速计算，已放行的部分不受影响
+	if (m_isAnchored) {
+		m_AnchorTime = DueTime(m_LastTimestamp);
+		m_AnchorTimestamp = m_LastTimestamp;
+	}
+	m_Rate = Rate(speed);
+
+	m_Condition.notify_all();
+}
+
+
+void IPCPacer::Reset()
+{
+	std::lock_guard<std::mutex> locker(m_Mutex);
+	m_isAnchored = false;
+	m_Condition.notify_all();
+}
+
+
+bool IPCPacer::Wait(quint64 timestamp, IPCCancelToken token)
+{
+	// 直播源不开启节流，每帧只多一次原子读
+	if (m_Lead.load(std::memory_order_relaxed) < 0) {
+		return !token.IsCanceled();
+	}
+
+	std::unique_lock<std::mutex> locker(m_Mutex);
+	if (m_Lead < 0) {
+		return !token.IsCanceled();
+	}
+
+	qint64 now = Now();
+	quint64 maxGap = (quint64)MaxGapSeconds * m_TicksPerSecond;
+	if (!m_isAnchored || timestamp < m_LastTimestamp || timestamp - m_LastTimestamp > maxGap) {
+		Anchor(timestamp, now);
+	}
+	else if (now - DueTime(timestamp) > MaxLag) {
+		// 写入端被阻塞过，从当前帧重新计时，避免之后连续放行一串帧
+		Anchor(timestamp, now);
+	}
+	m_LastTimestamp = timestamp;
+
+	if (DueTime(timestamp) - m_Lead <= now) {
+		return !token.IsCanceled();
+	}
+
+	// 确实要等才订阅取消；取消回调不持有令牌的锁执行，订阅和取消订阅时先放开m_Mutex，不会互相等待
+	locker.unlock();
+	quint64 id = token.Subscribe([this]() {
+		std::lock_guard<std::mutex> locker(m_Mutex);
+		m_Condition.notify_all();
+	});
+	if (id == 0) {
+		return false;
+	}
+	locker.lock();
+
+	// 每次被唤醒都按最新的倍速和配置重新计算
+	while (m_Lead >= 0 && m_isAnchored && !token.IsCanceled()) {
+		qint64 wait = DueTime(timestamp) - m_Lead - Now();
+		if (wait <= 0) {
+			break;
+		}
+
+		m_Condition.wait_for(locker, std::chrono::microseconds(wait));
+	}
+	locker.unlock();
+
+	token.Unsubscribe(id);
+
+	return !token.IsCanceled();
+}
+
+
+double IPCPacer::Rate(qint32 speed)
+{
+	return std::pow(100.0, qBound(-100, speed, 100) / 100.0);
+}
+
+
+void IPCPacer::Anchor(quint64 timestamp, qint64 now)
+{
+	m_isAnchored = true;
+	m_AnchorTimestamp = timestamp;
+	m_AnchorTime = now;
+}
+
+
+qint64 IPCPacer::DueTime(quint64 timestamp)
+{
+	double ticks = timestamp >= m_AnchorTimestamp ? (double)(timestamp - m_AnchorTimestamp) : -(double)(m_AnchorTimestamp - timestamp);
+	return m_AnchorTime + (qint64)(ticks * 1000000.0 / m_TicksPerSecond / m_Rate);
+}
+
+
+qint64 IPCPacer::Now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
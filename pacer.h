@@ -0,0 +1,72 @@
+#pragma once
+
+// project
+#include "cancel.h"
+
+// qt
+#include <QtCore/QtGlobal>
+
+// c/c++
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+
+
+// 写入端按时间戳节流，回放录像文件时以实时速度(乘以倍速)放行帧，避免一次性灌满缓冲区
+// 第一帧作为起点立即放行，此后每帧的放行时刻 = 起点时刻 + 时间戳差 / 倍速，允许提前lead放行
+// 时间戳回退或跳变、写入端落后太多时以当前帧重新作为起点，不追赶也不长时间等待
+class IPCPacer
+{
+public:
+    // 时间戳跳变超过这么多秒视为不连续
+    static const qint32 MaxGapSeconds = 10;
+    // 落后放行时刻超过这么多微秒时重新对齐，不再连续放行追赶
+    static const qint64 MaxLag = 500 * 1000;
+
+
+public:
+    IPCPacer();
+
+    // 开启节流，msLead为允许超前于放行时刻的毫秒数，负数关闭；ticksPerSecond为时间戳的单位，如毫秒为1000、MPEG-TS为90000
+    void Configure(qint32 msLead, quint32 ticksPerSecond);
+    // 是否开启
+    bool IsEnabled();
+    // 倍速，取值同SetSpeed事件[-100, 100]，0为原速；立即生效，正在等待的帧按新倍速重新计算
+    void SetSpeed(qint32 speed);
+    // 丢掉起点，下一帧立即放行并作为新的起点，跳转或换源时调用
+    void Reset();
+
+    // 等到时间戳为timestamp的帧可以放行，未开启时立即返回；被取消返回false
+    bool Wait(quint64 timestamp, IPCCancelToken token);
+
+    // 倍速值对应的播放速率，[-100, 100]按指数映射到[0.01, 100]
+    static double Rate(qint32 speed);
+
+
+private:
+    // 以timestamp和当前时刻为起点，调用方持有m_Mutex
+    void Anchor(quint64 timestamp, qint64 now);
+    // 时间戳对应的放行时刻(微秒)，调用方持有m_Mutex
+    qint64 DueTime(quint64 timestamp);
+    // 单调时钟(微秒)
+    static qint64 Now();
+
+    std::mutex m_Mutex;
+    // 倍速变化或取消时唤醒正在等待的帧
+    std::condition_variable m_Condition;
+
+    // 允许超前的微秒数，负数表示关闭；未开启时不加锁直接放行
+    std::atomic<qint64> m_Lead;
+    // 时间戳单位
+    quint32 m_TicksPerSecond;
+    // 播放速率
+    double m_Rate;
+
+    // 起点：时间戳及其放行时刻
+    bool m_isAnchored;
+    quint64 m_AnchorTimestamp;
+    qint64 m_AnchorTime;
+    // 上一帧的时间戳
+    quint64 m_LastTimestamp;
+};
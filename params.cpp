@@ -0,0 +1,118 @@
+// self
+#include "params.h"
+
+// qt
+#include <QtCore/QThread>
+
+// c/c++
+#include <new>
+
+
+
+static_assert(std::atomic<quint64>::is_always_lock_free, "shared memory parameter block requires lock free 64-bit atomics");
+
+
+IPCParameterBlock::IPCParameterBlock()
+	: m_pHeader(nullptr)
+{
+}
+
+
+qsizetype IPCParameterBlock::Bytes()
+{
+	return (sizeof(Header) + 63) & ~63;
+}
+
+
+void IPCParameterBlock::Format(void *address)
+{
+	m_pHeader = new (address) Header();
+	m_pHeader->sequence.store(0, std::memory_order_relaxed);
+	m_pHeader->mask.store(0, std::memory_order_relaxed);
+	for (quint32 i = 0; i < Count; i++) {
+		m_pHeader->values[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+
+void IPCParameterBlock::Attach(void *address)
+{
+	m_pHeader = (Header *)address;
+}
+
+
+void IPCParameterBlock::Resume(void *address)
+{
+	m_pHeader = (Header *)address;
+
+	quint64 sequence = m_pHeader->sequence.load(std::memory_order_relaxed);
+	if (sequence & 1) {
+		m_pHeader->sequence.store(sequence + 1, std::memory_order_release);
+	}
+}
+
+
+void IPCParameterBlock::Detach()
+{
+	m_pHeader = nullptr;
+}
+
+
+bool IPCParameterBlock::IsAttached()
+{
+	return m_pHeader != nullptr;
+}
+
+
+void IPCParameterBlock::Publish(Parameter parameter, qint32 value)
+{
+	if (parameter >= Count) {
+		return;
+	}
+
+	// 序号变为奇数之后才能改值，读取端据此发现正在写入
+	quint64 sequence = m_pHeader->sequence.load(std::memory_order_relaxed);
+	m_pHeader->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	m_pHeader->values[parameter].store(value, std::memory_order_relaxed);
+	m_pHeader->mask.fetch_or(1u << parameter, std::memory_order_relaxed);
+
+	m_pHeader->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+
+bool IPCParameterBlock::Sample(Snapshot &snapshot)
+{
+	for (qint32 retry = 0; retry < MaxRetries; retry++) {
+		quint64 begin = m_pHeader->sequence.load(std::memory_order_acquire);
+		if (begin & 1) {
+			// 写入只改几个字，让出时间片等它写完即可
+			QThread::yieldCurrentThread();
+			continue;
+		}
+
+		Snapshot sample;
+		sample.mask = m_pHeader->mask.load(std::memory_order_relaxed);
+		for (quint32 i = 0; i < Count; i++) {
+			sample.values[i] = m_pHeader->values[i].load(std::memory_order_relaxed);
+		}
+
+		// 读完值再确认序号没有变化
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (m_pHeader->sequence.load(std::memory_order_relaxed) == begin) {
+			sample.generation = begin / 2;
+			snapshot = sample;
+			return true;
+		}
+	}
+
+	// 写入端在发布中途退出，序号一直是奇数，等常驻通道的新写入端接管时补齐
+	return false;
+}
+
+
+quint64 IPCParameterBlock::Generation()
+{
+	return m_pHeader->sequence.load(std::memory_order_acquire) / 2;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+// qt
+#include <QtCore/QtGlobal>
+
+// c/c++
+#include <atomic>
+
+
+
+// 位于共享内存中的参数块，保存连续调节的参数(滤镜、倍速)的最新值，后写覆盖先写
+// 单写多读的顺序锁：写入端发布前后各把序号加一，序号为奇数表示正在写入
+// 读取端读到前后序号相同且为偶数才算一份一致的快照，否则重读；写入端在发布中途退出时序号停在奇数，重读有上限
+class IPCParameterBlock
+{
+public:
+    // 读取端取快照的最多尝试次数，每次失败让出一次时间片；正常发布只改几个字，远用不到
+    static const qint32 MaxRetries = 1000;
+
+    // 参数
+    enum Parameter : quint32
+    {
+        Brightness = 0,
+        Contrast,
+        Saturation,
+        Gamma,
+        Speed,
+        Count,
+    };
+
+    // 共享内存中的布局
+    struct Header
+    {
+        // 顺序锁序号，只由写入端修改
+        alignas(64) std::atomic<quint64> sequence;
+        // 已发布过的参数，按位对应Parameter
+        std::atomic<quint32> mask;
+        // 各参数的最新值
+        std::atomic<qint32> values[Count];
+    };
+
+    // 读取端取到的快照
+    struct Snapshot
+    {
+        // 代数，每发布一次加一
+        quint64 generation;
+        // 已发布过的参数，未发布的参数值无意义
+        quint32 mask;
+        qint32 values[Count];
+    };
+
+
+public:
+    IPCParameterBlock();
+
+    // 需要的共享内存字节数
+    static qsizetype Bytes();
+
+    // 写入端创建共享内存后初始化
+    void Format(void *address);
+    // 读取端挂载共享内存后映射
+    void Attach(void *address);
+    // 常驻通道的写入端接管：上一个写入端可能在发布中途退出，把序号补成偶数
+    void Resume(void *address);
+    // 解除映射
+    void Detach();
+    // 是否已映射
+    bool IsAttached();
+
+    // 写入端：发布一个参数的最新值，调用方保证同一时刻只有一个线程发布
+    void Publish(Parameter parameter, qint32 value);
+    // 读取端：取一份一致的快照，不阻塞写入端；写入端停在发布中途时重试MaxRetries次后返回false，snapshot不变
+    bool Sample(Snapshot &snapshot);
+    // 当前代数
+    quint64 Generation();
+
+
+private:
+    // 共享内存中的参数块
+    Header *m_pHeader;
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+// qt
+#include <QtCore/QtGlobal>
+
+// c/c++
+#include <atomic>
+#include <memory>
+#include <utility>
+
+
+
+// 进程内有界无锁队列，多写多读，容量为2的幂
+// 每个槽位带序号，写入端和读取端各自用CAS推进位置，槽位序号表示该槽位当前可写还是可读
+template<typename T>
+class IPCBoundedQueue
+{
+public:
+    explicit IPCBoundedQueue(qsizetype capacity)
+        : m_Mask(RoundUp(capacity) - 1)
+        , m_pCells(new Cell[m_Mask + 1])
+        , m_writeIndex(0)
+        , m_readIndex(0)
+    {
+        for (quint64 i = 0; i <= m_Mask; i++) {
+            m_pCells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    Q_DISABLE_COPY(IPCBoundedQueue)
+
+    // 入队，队列已满返回false，value保持不变
+    bool TryPush(T &value)
+    {
+        Cell *pCell = nullptr;
+        quint64 index = m_writeIndex.load(std::memory_order_relaxed);
+        while (true) {
+            pCell = &m_pCells[index & m_Mask];
+            quint64 sequence = pCell->sequence.load(std::memory_order_acquire);
+            qint64 diff = (qint64)sequence - (qint64)index;
+            if (diff == 0) {
+                if (m_writeIndex.compare_exchange_weak(index, index + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                index = m_writeIndex.load(std::memory_order_relaxed);
+            }
+        }
+
+        pCell->value = std::move(value);
+        pCell->sequence.store(index + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // 出队，队列为空返回false
+    bool TryPop(T &value)
+    {
+        Cell *pCell = nullptr;
+        quint64 index = m_readIndex.load(std::memory_order_relaxed);
+        while (true) {
+            pCell = &m_pCells[index & m_Mask];
+            quint64 sequence = pCell->sequence.load(std::memory_order_acquire);
+            qint64 diff = (qint64)sequence - (qint64)(index + 1);
+            if (diff == 0) {
+                if (m_readIndex.compare_exchange_weak(index, index + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                index = m_readIndex.load(std::memory_order_relaxed);
+            }
+        }
+
+        value = std::move(pCell->value);
+        pCell->value = T();
+        pCell->sequence.store(index + m_Mask + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // 近似的元素个数
+    qsizetype Size()
+    {
+        qint64 size = (qint64)(m_writeIndex.load(std::memory_order_relaxed) - m_readIndex.load(std::memory_order_relaxed));
+        return size < 0 ? 0 : (qsizetype)size;
+    }
+
+    // 容量
+    qsizetype Capacity()
+    {
+        return (qsizetype)(m_Mask + 1);
+    }
+
+
+private:
+    // 槽位
+    struct Cell
+    {
+        std::atomic<quint64> sequence;
+        T value;
+    };
+
+    static quint64 RoundUp(qsizetype capacity)
+    {
+        quint64 size = 2;
+        while (size < (quint64)capacity) {
+            size <<= 1;
+        }
+
+        return size;
+    }
+
+    const quint64 m_Mask;
+    std::unique_ptr<Cell[]> m_pCells;
+
+    // 写入位置和读取位置各占一个缓存行
+    alignas(64) std::atomic<quint64> m_writeIndex;
+    alignas(64) std::atomic<quint64> m_readIndex;
+};
@@ -0,0 +1,474 @@
+// self
+#include "reactor.h"
+
+// project
+#include "../logger/logger.h"
+#if defined(MPV_CLIENT)
+#include "../client/common.h"
+#else
+#include "../server/common.h"
+#endif
+
+// qt
+#include <QtCore/QVector>
+
+#if defined(Q_OS_WIN)
+// qt
+#include <QtCore/QWinEventNotifier>
+
+// windows
+#include <Windows.h>
+#else
+// qt
+#include <QtCore/QSocketNotifier>
+
+// c/c++
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+
+
+IPCReactor::IPCReactor(QObject *parent)
+	: QObject(parent)
+	, m_NextId(1)
+	, m_isStopping(false)
+	, m_isAttached(false)
+#if defined(Q_OS_WIN)
+	, m_hStop(nullptr)
+	, m_hTask(nullptr)
+#else
+	, m_epollFd(-1)
+	, m_stopFd(-1)
+	, m_taskFd(-1)
+	, m_pSocketNotifier(nullptr)
+#endif
+{
+#if defined(Q_OS_WIN)
+	m_hStop = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+	m_hTask = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+#else
+	m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+	m_stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	m_taskFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	struct epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.u64 = 0;
+	struct epoll_event taskEvent = {};
+	taskEvent.events = EPOLLIN;
+	taskEvent.data.u64 = TaskId;
+	if (m_epollFd < 0 || m_stopFd < 0 || m_taskFd < 0
+		|| epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_stopFd, &event) != 0
+		|| epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_taskFd, &taskEvent) != 0) {
+		LogWarning() << QString("create reactor fail, errno: %1\n").arg(errno);
+	}
+#endif
+}
+
+
+IPCReactor::~IPCReactor()
+{
+	QList<IPC *> channels;
+	{
+		std::lock_guard<std::mutex> locker(m_Mutex);
+		channels = m_Ids.keys();
+	}
+
+	for (IPC *pIpc : channels) {
+		Remove(*pIpc);
+	}
+
+#if defined(Q_OS_WIN)
+	if (m_hStop != nullptr) {
+		CloseHandle(m_hStop);
+		m_hStop = nullptr;
+	}
+
+	if (m_hTask != nullptr) {
+		CloseHandle(m_hTask);
+		m_hTask = nullptr;
+	}
+#else
+	if (!IsNullPtr(m_pSocketNotifier)) {
+		delete m_pSocketNotifier;
+		m_pSocketNotifier = nullptr;
+	}
+
+	if (m_stopFd >= 0) {
+		close(m_stopFd);
+		m_stopFd = -1;
+	}
+
+	if (m_taskFd >= 0) {
+		close(m_taskFd);
+		m_taskFd = -1;
+	}
+
+	if (m_epollFd >= 0) {
+		close(m_epollFd);
+		m_epollFd = -1;
+	}
+#endif
+}
+
+
+bool IPCReactor::Add(IPC &ipc, const Callback &callback)
+{
+	// 一个通道只有一个回调，已注册时不替换，否则原注册者的回调被悄悄丢掉、注销时又会注销别人的注册
+	{
+		std::lock_guard<std::mutex> locker(m_Mutex);
+		if (m_Ids.contains(&ipc)) {
+			LogWarningC("channel already registered\n");
+			return false;
+		}
+	}
+
+	qintptr handle = ipc.WakeHandle();
+	if (handle < 0 || !ipc.Watch(true)) {
+		LogWarningC("reactor only supports started single layout channels\n");
+		return false;
+	}
+
+	quint64 id = 0;
+	{
+		std::lock_guard<std::mutex> locker(m_Mutex);
+
+		// 另一个线程同时注册了同一个通道，监听状态归它所有，不关闭
+		if (m_Ids.contains(&ipc)) {
+			LogWarningC("channel already registered\n");
+			return false;
+		}
+
+		id = m_NextId++;
+
+#if defined(Q_OS_WIN)
+		// WaitForMultipleObjects最多等待64个句柄，其中两个是停止和任务通知
+		if (!m_isAttached && m_Channels.size() >= MAXIMUM_WAIT_OBJECTS - 2) {
+			LogWarningC("too many channels for one reactor\n");
+			ipc.Watch(false);
+			return false;
+		}
+
+		QWinEventNotifier *pNotifier = nullptr;
+		if (m_isAttached) {
+			pNotifier = new QWinEventNotifier((HANDLE)handle, this);
+			connect(pNotifier, &QWinEventNotifier::activated, this, [this, id]() { Dispatch(id); });
+		}
+
+		m_Channels.insert(id, { &ipc, callback, QMetaObject::Connection(), pNotifier });
+#else
+		struct epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.u64 = id;
+		if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, (int)handle, &event) != 0) {
+			LogWarning() << QString("epoll add fail, errno: %1\n").arg(errno);
+			ipc.Watch(false);
+			return false;
+		}
+
+		m_Channels.insert(id, { &ipc, callback, QMetaObject::Connection() });
+#endif
+
+		m_Ids.insert(&ipc, id);
+
+		// 终止时唤醒句柄随之关闭，须在关闭之前注销，之后也不能再回调
+		IPC *pIpc = &ipc;
+		m_Channels[id].stopping = connect(&ipc, &IPC::Stopping, this, [this, pIpc]() { Remove(*pIpc); }, Qt::DirectConnection);
+	}
+
+	// 登记之前提交的数据和反馈不会再有通知，先处理一次
+	if (ipc.IsReadable() || ipc.HasFeedback()) {
+		Dispatch(id);
+	}
+
+	return true;
+}
+
+
+bool IPCReactor::Remove(IPC &ipc)
+{
+	std::unique_lock<std::mutex> locker(m_Mutex);
+
+	if (!m_Ids.contains(&ipc)) {
+		return false;
+	}
+
+	// 先从表里摘掉，之后不会再开始新的回调
+	quint64 id = m_Ids.take(&ipc);
+	Channel channel = m_Channels.take(id);
+	disconnect(channel.stopping);
+
+	// 通道终止时在返回后就会释放通知对象，须等正在执行的回调结束；回调里注销自己不等
+	std::thread::id self = std::this_thread::get_id();
+	if (m_Busy.contains(id) && m_Busy.value(id) != self) {
+#if defined(Q_OS_WIN)
+		// 事件循环可能正阻塞在包含该通道句柄的等待上，唤醒一次
+		SetEvent(m_hTask);
+#endif
+		m_Idle.wait(locker, [this, id, self]() { return !m_Busy.contains(id) || m_Busy.value(id) == self; });
+	}
+
+#if defined(Q_OS_WIN)
+	if (!IsNullPtr(channel.pNotifier)) {
+		channel.pNotifier->setEnabled(false);
+		channel.pNotifier->deleteLater();
+	}
+#else
+	qintptr handle = ipc.WakeHandle();
+	if (handle >= 0) {
+		epoll_ctl(m_epollFd, EPOLL_CTL_DEL, (int)handle, nullptr);
+	}
+#endif
+
+	ipc.Watch(false);
+
+	return true;
+}
+
+
+qsizetype IPCReactor::Count()
+{
+	std::lock_guard<std::mutex> locker(m_Mutex);
+	return m_Channels.size();
+}
+
+
+qint32 IPCReactor::RunOnce(qint32 msTimeout)
+{
+#if defined(Q_OS_WIN)
+	QVector<HANDLE> handles;
+	QVector<quint64> ids;
+	handles.append(m_hStop);
+	ids.append(0);
+	handles.append(m_hTask);
+	ids.append(TaskId);
+	{
+		std::lock_guard<std::mutex> locker(m_Mutex);
+		for (quint64 id : m_Channels.keys()) {
+			handles.append((HANDLE)m_Channels[id].pIpc->WakeHandle());
+			ids.append(id);
+		}
+	}
+
+	// 等待期间句柄不能被关闭，整个等待和分发过程都登记为正在使用
+	QVector<quint64> entered = Enter(ids.mid(2));
+
+	DWORD ret = WaitForMultipleObjects((DWORD)handles.size(), handles.data(), FALSE, msTimeout < 0 ? INFINITE : (DWORD)msTimeout);
+	if (ret <= WAIT_OBJECT_0 || ret >= WAIT_OBJECT_0 + (DWORD)handles.size()) {
+		Leave(entered);
+		return 0;
+	}
+
+	// 一次只报告序号最小的句柄，其余就绪的句柄不等待再查一遍，避免靠前的通道饿死靠后的
+	qint32 count = 0;
+	for (int i = ret - WAIT_OBJECT_0; i < handles.size(); i++) {
+		if (i == (int)(ret - WAIT_OBJECT_0) || WaitForSingleObject(handles[i], 0) == WAIT_OBJECT_0) {
+			if (ids[i] == TaskId) {
+				RunTasks();
+				continue;
+			}
+
+			Dispatch(ids[i]);
+			count++;
+		}
+	}
+
+	Leave(entered);
+
+	return count;
+#else
+	struct epoll_event events[64];
+
+	int ret = 0;
+	do {
+		ret = epoll_wait(m_epollFd, events, 64, msTimeout);
+	} while (ret < 0 && errno == EINTR);
+
+	qint32 count = 0;
+	for (int i = 0; i < ret; i++) {
+		// 接入Qt事件循环时Stop也会写入停止通知，不读走的话监听epoll的描述符会一直可读
+		if (events[i].data.u64 == 0) {
+			eventfd_t value = 0;
+			eventfd_read(m_stopFd, &value);
+			continue;
+		}
+
+		if (events[i].data.u64 == TaskId) {
+			eventfd_t value = 0;
+			eventfd_read(m_taskFd, &value);
+			RunTasks();
+			continue;
+		}
+
+		Dispatch(events[i].data.u64);
+		count++;
+	}
+
+	return count;
+#endif
+}
+
+
+void IPCReactor::Run()
+{
+	m_isStopping = false;
+
+#if defined(Q_OS_WIN)
+	ResetEvent(m_hStop);
+#else
+	eventfd_t value = 0;
+	eventfd_read(m_stopFd, &value);
+#endif
+
+	while (!m_isStopping) {
+		RunOnce(-1);
+	}
+}
+
+
+void IPCReactor::Stop()
+{
+	m_isStopping = true;
+
+#if defined(Q_OS_WIN)
+	SetEvent(m_hStop);
+#else
+	eventfd_write(m_stopFd, 1);
+#endif
+}
+
+
+void IPCReactor::Post(const std::function<void()> &task)
+{
+	std::lock_guard<std::mutex> locker(m_Mutex);
+
+	// 接入Qt事件循环后由事件队列排队执行，不经过任务通知
+	if (m_isAttached) {
+		QMetaObject::invokeMethod(this, task, Qt::QueuedConnection);
+		return;
+	}
+
+	m_Tasks.append(task);
+
+#if defined(Q_OS_WIN)
+	SetEvent(m_hTask);
+#else
+	eventfd_write(m_taskFd, 1);
+#endif
+}
+
+
+bool IPCReactor::AttachToEventLoop()
+{
+	std::lock_guard<std::mutex> locker(m_Mutex);
+
+	if (m_isAttached) {
+		return true;
+	}
+
+#if defined(Q_OS_WIN)
+	// 每个通道一个QWinEventNotifier，不受64个句柄的限制
+	for (quint64 id : m_Channels.keys()) {
+		Channel &channel = m_Channels[id];
+		channel.pNotifier = new QWinEventNotifier((HANDLE)channel.pIpc->WakeHandle(), this);
+		connect(channel.pNotifier, &QWinEventNotifier::activated, this, [this, id]() { Dispatch(id); });
+	}
+#else
+	// epoll描述符本身在有通道就绪时可读，事件循环只需监听这一个描述符
+	if (m_epollFd < 0) {
+		return false;
+	}
+
+	m_pSocketNotifier = new QSocketNotifier(m_epollFd, QSocketNotifier::Read, this);
+	connect(m_pSocketNotifier, &QSocketNotifier::activated, this, [this]() { RunOnce(0); });
+#endif
+
+	m_isAttached = true;
+
+	return true;
+}
+
+
+void IPCReactor::RunTasks()
+{
+	QVector<std::function<void()>> tasks;
+	{
+		std::lock_guard<std::mutex> locker(m_Mutex);
+		tasks.swap(m_Tasks);
+	}
+
+	// 不持锁执行，任务里可以再注册或注销通道
+	for (const std::function<void()> &task : tasks) {
+		task();
+	}
+}
+
+
+QVector<quint64> IPCReactor::Enter(const QVector<quint64> &ids)
+{
+	std::lock_guard<std::mutex> locker(m_Mutex);
+
+	QVector<quint64> entered;
+	for (quint64 id : ids) {
+		if (m_Channels.contains(id) && !m_Busy.contains(id)) {
+			m_Busy.insert(id, std::this_thread::get_id());
+			entered.append(id);
+		}
+	}
+
+	return entered;
+}
+
+
+void IPCReactor::Leave(const QVector<quint64> &ids)
+{
+	if (ids.isEmpty()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> locker(m_Mutex);
+		for (quint64 id : ids) {
+			m_Busy.remove(id);
+		}
+	}
+
+	m_Idle.notify_all();
+}
+
+
+void IPCReactor::Dispatch(quint64 id)
+{
+	IPC *pIpc = nullptr;
+	Callback callback;
+	bool entered = false;
+	{
+		std::lock_guard<std::mutex> locker(m_Mutex);
+		if (!m_Channels.contains(id)) {
+			return;
+		}
+
+		pIpc = m_Channels[id].pIpc;
+		callback = m_Channels[id].callback;
+
+		// 登记正在回调，其它线程注销时等回调结束
+		entered = !m_Busy.contains(id);
+		if (entered) {
+			m_Busy.insert(id, std::this_thread::get_id());
+		}
+	}
+
+	// 先消费通知再回调，回调期间新提交的数据会再次通知，不会错过
+	pIpc->ConsumeWakeup();
+
+	if (callback) {
+		callback(*pIpc);
+	}
+
+	if (entered) {
+		Leave({ id });
+	}
+}
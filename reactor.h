@@ -0,0 +1,116 @@
+#pragma once
+
+// project
+#include "ipc.h"
+
+// qt
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QVector>
+
+// c/c++
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+
+
+class QSocketNotifier;
+class QWinEventNotifier;
+
+
+// 单线程事件循环，同时服务多个单块布局的通道，读取端等数据，写入端等空间
+// Linux 下用epoll监听各通道的可读句柄，Windows 下用WaitForMultipleObjects
+// 可以在独立线程中调用Run，也可以用AttachToEventLoop接入所在线程的Qt事件循环
+// Windows 下不接入Qt事件循环时最多注册62个通道(WaitForMultipleObjects最多64个句柄，另两个是停止和任务通知)，接入后不受限制
+// 通道终止读取端/写入端时自动注销，不会在之后的回调中访问已终止的通道：在其它线程注销时等正在执行的回调结束才返回
+class IPCReactor : public QObject
+{
+    Q_OBJECT
+
+
+public:
+    // 通道可读时的回调，在事件循环线程中执行；回调里应读到IsReadable为false为止
+    using Callback = std::function<void(IPC &ipc)>;
+
+    explicit IPCReactor(QObject *parent = nullptr);
+    ~IPCReactor();
+
+    // 注册通道，ipc须已开启读取端或写入端；读取端已有数据、写入端已有反馈时会立即回调一次
+    // 一个通道同时只能注册一次，已注册时返回false
+    bool Add(IPC &ipc, const Callback &callback);
+    // 注销通道，通道终止时也会自动注销；在事件循环线程以外调用时等该通道正在执行的回调结束
+    bool Remove(IPC &ipc);
+    // 已注册的通道数
+    qsizetype Count();
+
+    // 等待并处理一批可读通道，返回处理的通道数；msTimeout < 0 表示一直等待
+    qint32 RunOnce(qint32 msTimeout);
+    // 在当前线程循环处理，直到Stop
+    void Run();
+    // 让Run返回，可在任意线程调用；接入Qt事件循环时没有作用
+    void Stop();
+    // 在事件循环线程中执行task，可在任意线程调用；Run模式下由下一次RunOnce执行，接入Qt事件循环时排入事件队列
+    void Post(const std::function<void()> &task);
+
+    // 接入当前线程的Qt事件循环，之后不要再调用Run
+    bool AttachToEventLoop();
+
+
+private:
+    // 已注册的通道
+    struct Channel
+    {
+        IPC *pIpc;
+        Callback callback;
+        // 通道终止时自动注销
+        QMetaObject::Connection stopping;
+#if defined(Q_OS_WIN)
+        QWinEventNotifier *pNotifier;
+#endif
+    };
+
+    // 处理一个被唤醒的通道
+    void Dispatch(quint64 id);
+    // 执行Post进来的任务
+    void RunTasks();
+    // 登记通道正在被事件循环线程使用，返回实际登记的编号；已注销或已登记的跳过
+    QVector<quint64> Enter(const QVector<quint64> &ids);
+    // 取消登记并唤醒等待注销的线程
+    void Leave(const QVector<quint64> &ids);
+
+    // 任务通知的编号，通道编号从1开始递增，不会用到
+    static const quint64 TaskId = ~0ull;
+
+    std::mutex m_Mutex;
+    QHash<quint64, Channel> m_Channels;
+    QHash<IPC *, quint64> m_Ids;
+    // 通道编号，0留给停止通知
+    quint64 m_NextId;
+    // Post进来等待执行的任务
+    QVector<std::function<void()>> m_Tasks;
+    // 正在回调(Windows 下还包括正在等待句柄)的通道及所在线程，注销时等到不在其中
+    QHash<quint64, std::thread::id> m_Busy;
+    std::condition_variable m_Idle;
+
+    std::atomic<bool> m_isStopping;
+    // 是否已接入Qt事件循环
+    bool m_isAttached;
+
+#if defined(Q_OS_WIN)
+    // 停止通知，手动复位事件
+    void *m_hStop;
+    // 任务通知，自动复位事件
+    void *m_hTask;
+#else
+    int m_epollFd;
+    // 停止通知
+    int m_stopFd;
+    // 任务通知
+    int m_taskFd;
+    // 接入Qt事件循环时监听epoll描述符
+    QSocketNotifier *m_pSocketNotifier;
+#endif
+};
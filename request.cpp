@@ -6,9 +6,6 @@
 
 
 
-std::mutex Request::sMutex;
-
-
 void Request::Int32Serialization(int32_t size, char *bytes)
 {
 	// size 序列化成 byte array
@@ -26,73 +23,49 @@ bool Request::Send(IPC &ipc, QByteArray &commonHeader, QByteArray &extendHeader)
 	char pBufferSize[sizeof(nbytesCommonHeader)];
 	Int32Serialization(nbytesCommonHeader, pBufferSize);
 
-	// 加锁
-	std::lock_guard<std::mutex> locker(sMutex);
-
-	IPC::WriteError error;
-
-	// 写 size
-	bool status = ipc.Write(pBufferSize, sizeof(nbytesCommonHeader), error);
-	if (!status) {
-		LogWarning() << QString("ipc write common header size fail, nbytes: %1, error: %2\n").arg(sizeof(nbytesCommonHeader)).arg((qint32)error);
-		return false;
-	}
-
-	// 写 common header
-	status = ipc.Write(commonHeader, error);
-	if (!status) {
-		LogWarning() << QString("ipc write common header fail, nbytes: %1, error: %2\n").arg(commonHeader.size()).arg((qint32)error);
-		return false;
-	}
+	return Send(ipc, {
+		{ pBufferSize, sizeof(nbytesCommonHeader) },
+		{ commonHeader.constData(), commonHeader.size() },
+		{ extendHeader.constData(), extendHeader.size() },
+	});
+}
 
-	// 写 extend header
-	status = ipc.Write(extendHeader, error);
-	if (!status) {
-		LogWarning() << QString("ipc write extend header fail, nbytes: %1, error: %2\n").arg(extendHeader.size()).arg((qint32)error);
-		return false;
-	}
 
-	return true;
+bool Request::Send(IPC &ipc, QByteArray &commonHeader, QByteArray &extendHeader, QByteArray &content)
+{
+	return Send(ipc, commonHeader, extendHeader, content.constData(), content.size());
 }
 
 
-bool Request::Send(IPC &ipc, QByteArray &commonHeader, QByteArray &extendHeader, QByteArray &content)
+bool Request::Send(IPC &ipc, QByteArray &commonHeader, QByteArray &extendHeader, const char *content, int32_t nbytes)
 {
 	// size 序列化成 byte array
 	int32_t nbytesCommonHeader = commonHeader.size();
 	char pBufferSize[sizeof(nbytesCommonHeader)];
 	Int32Serialization(nbytesCommonHeader, pBufferSize);
 
-	// 加锁
-	std::lock_guard<std::mutex> locker(sMutex);
+	return Send(ipc, {
+		{ pBufferSize, sizeof(nbytesCommonHeader) },
+		{ commonHeader.constData(), commonHeader.size() },
+		{ extendHeader.constData(), extendHeader.size() },
+		{ content, nbytes },
+	});
+}
 
-	IPC::WriteError error;
 
-	// 写 size
-	bool status = ipc.Write(pBufferSize, sizeof(nbytesCommonHeader), error);
-	if (!status) {
-		LogWarning() << QString("ipc write common header size fail, nbytes: %1, error: %2\n").arg(sizeof(nbytesCommonHeader)).arg((qint32)error);
-		return false;
-	}
+bool Request::Send(IPC &ipc, const QVector<IPC::Buffer> &buffers)
+{
+	IPC::WriteError error;
 
-	// 写 common header
-	status = ipc.Write(commonHeader, error);
+	// 依次写 size、common header、extend header、content，单块布局下一次提交
+	bool status = ipc.Write(buffers, error);
 	if (!status) {
-		LogWarning() << QString("ipc write common header fail, nbytes: %1, error: %2\n").arg(commonHeader.size()).arg((qint32)error);
-		return false;
-	}
+		qint64 nbytes = 0;
+		for (const IPC::Buffer &buffer : buffers) {
+			nbytes += buffer.nbytes;
+		}
 
-	// 写 extend header
-	status = ipc.Write(extendHeader, error);
-	if (!status) {
-		LogWarning() << QString("ipc write extend header fail, nbytes: %1, error: %2\n").arg(extendHeader.size()).arg((qint32)error);
-		return false;
-	}
-
-	// 写 content
-	status = ipc.Write(content, error);
-	if (!status) {
-		LogWarning() << QString("ipc write content fail, nbytes: %1, error: %2\n").arg(content.size()).arg((qint32)error);
+		LogWarning() << QString("ipc write message fail, parts: %1, nbytes: %2, error: %3\n").arg(buffers.size()).arg(nbytes).arg((qint32)error);
 		return false;
 	}
 
@@ -100,43 +73,36 @@ bool Request::Send(IPC &ipc, QByteArray &commonHeader, QByteArray &extendHeader,
 }
 
 
-bool Request::Send(IPC &ipc, QByteArray &commonHeader, QByteArray &extendHeader, const char *content, int32_t nbytes)
+bool Request::SendEvent(IPC &ipc, message::EventHead::Type type, QByteArray &commonHeader, QByteArray &eventHeader, const char *content, int32_t nbytes)
 {
 	// size 序列化成 byte array
 	int32_t nbytesCommonHeader = commonHeader.size();
 	char pBufferSize[sizeof(nbytesCommonHeader)];
 	Int32Serialization(nbytesCommonHeader, pBufferSize);
 
-	// 加锁
-	std::lock_guard<std::mutex> locker(sMutex);
-
-	IPC::WriteError error;
-
-	// 写 size
-	bool status = ipc.Write(pBufferSize, sizeof(nbytesCommonHeader), error);
-	if (!status) {
-		LogWarning() << QString("ipc write common header size fail, nbytes: %1, error: %2\n").arg(sizeof(nbytesCommonHeader)).arg((qint32)error);
-		return false;
+	QVector<IPC::Buffer> buffers = {
+		{ pBufferSize, sizeof(nbytesCommonHeader) },
+		{ commonHeader.constData(), commonHeader.size() },
+		{ eventHeader.constData(), eventHeader.size() },
+	};
+	if (nbytes > 0) {
+		buffers.append({ content, nbytes });
 	}
 
-	// 写 common header
-	status = ipc.Write(commonHeader, error);
-	if (!status) {
-		LogWarning() << QString("ipc write common header fail, nbytes: %1, error: %2\n").arg(commonHeader.size()).arg((qint32)error);
-		return false;
+	// 读取端没有订阅事件时直接跳过
+	if (!ipc.IsSubscribed(message::CommonHead_Type_Event)) {
+		return true;
 	}
 
-	// 写 extend header
-	status = ipc.Write(extendHeader, error);
-	if (!status) {
-		LogWarning() << QString("ipc write extend header fail, nbytes: %1, error: %2\n").arg(extendHeader.size()).arg((qint32)error);
-		return false;
+	// 没有控制通道时与视频帧共用数据通道
+	if (!ipc.HasControlLane()) {
+		return Send(ipc, buffers);
 	}
 
-	// 写 content
-	status = ipc.Write(content, nbytes, error);
-	if (!status) {
-		LogWarning() << QString("ipc write content fail, nbytes: %1, error: %2\n").arg(nbytes).arg((qint32)error);
+	// 控制通道有自己的锁，不会排在视频帧后面
+	IPC::WriteError error;
+	if (!ipc.WriteControl(buffers, IsOrderedEvent(type), error)) {
+		LogWarning() << QString("ipc write control fail, type: %1, error: %2\n").arg((qint32)type).arg((qint32)error);
 		return false;
 	}
 
@@ -144,6 +110,20 @@ bool Request::Send(IPC &ipc, QByteArray &commonHeader, QByteArray &extendHeader,
 }
 
 
+bool Request::IsOrderedEvent(message::EventHead::Type type)
+{
+	// 与码流位置相关的事件要在此前的视频帧之后交付，其余控制立即生效
+	switch (type) {
+	case message::EventHead_Type_Close:
+	case message::EventHead_Type_StartRecordStream:
+	case message::EventHead_Type_StopRecordStream:
+		return true;
+	default:
+		return false;
+	}
+}
+
+
 bool VideoRequest::Send(
 	IPC &ipc, char *content, uint32_t nbytes,
 	enum message::VideoHead_FrameType type, enum message::VideoHead_Codec codec,
@@ -193,8 +173,53 @@ bool VideoRequest::Send(
 
 	// content 无需序列化
 
-	if (!Request::Send(ipc, pBufferCommonHeader, pBufferVideoHeader, content, nbytes)) {
-		LogWarningC("send video fail\n");
+	// size 序列化成 byte array
+	char pBufferSize[sizeof(nbytesCommonHeader)];
+	Int32Serialization(nbytesCommonHeader, pBufferSize);
+
+	QVector<IPC::Buffer> buffers = {
+		{ pBufferSize, sizeof(nbytesCommonHeader) },
+		{ pBufferCommonHeader.constData(), pBufferCommonHeader.size() },
+		{ pBufferVideoHeader.constData(), pBufferVideoHeader.size() },
+		{ content, nbytes },
+	};
+
+	// 读取端没有订阅的帧直接跳过，不写入共享内存
+	if (!ipc.IsSubscribed(message::CommonHead_Type_Video, type)) {
+		return true;
+	}
+
+	// 开启节流时按时间戳放行；帧按解码顺序发送，有dts时按dts，否则按pts
+	IPC::WriteError error;
+	if (!ipc.PaceFrame(dts != 0 || pts == 0 ? dts : pts, error)) {
+		LogWarning() << QString("pace video fail, error: %1\n").arg((qint32)error);
+		return false;
+	}
+
+	// 背压：读取端跟不上时按策略丢帧，丢帧不算发送失败
+	if (ipc.ShouldDropFrame(type == message::VideoHead_FrameType_IntraCoded, buffers)) {
+		return true;
+	}
+
+	// 开启了GOP缓存时，写入的同时更新缓存
+	if (!ipc.WriteFrame(type == message::VideoHead_FrameType_IntraCoded, buffers, error)) {
+		LogWarning() << QString("send video fail, error: %1\n").arg((qint32)error);
+		return false;
+	}
+
+	return true;
+}
+
+
+bool VideoConfigRequest::Send(IPC &ipc, enum message::VideoHead_Codec codec, const char *extradata, int nbytes)
+{
+	if (!ipc.HasParameterBlock()) {
+		return true;
+	}
+
+	IPC::WriteError error;
+	if (!ipc.PublishExtradata(codec, extradata, nbytes, error)) {
+		LogWarning() << QString("ipc publish extradata fail, codec: %1, error: %2\n").arg((qint32)codec).arg((qint32)error);
 		return false;
 	}
 
@@ -235,7 +260,7 @@ bool EventSimpleRequest::Send(IPC &ipc, message::EventHead::Type type)
 	// 没有正文
 
 	// 发送
-	return Request::Send(ipc, pBufferCommonHeader, pBufferEventHeader);
+	return Request::SendEvent(ipc, type, pBufferCommonHeader, pBufferEventHeader, nullptr, 0);
 }
 
 
@@ -280,7 +305,24 @@ bool EventSetIntRequest::Send(IPC &ipc, message::EventHead::Type type, int value
 	Request::Int32Serialization(value, content);
 
 	// 发送
-	return Request::Send(ipc, pBufferCommonHeader, pBufferEventHeader, content, sizeof(int));
+	return Request::SendEvent(ipc, type, pBufferCommonHeader, pBufferEventHeader, content, sizeof(int));
+}
+
+
+bool EventSetIntRequest::SendLatest(IPC &ipc, message::EventHead::Type type, IPCParameterBlock::Parameter parameter, int value)
+{
+	// 中间值不再排队，读取端每帧采样时只看到最新值
+	if (ipc.HasParameterBlock()) {
+		IPC::WriteError error;
+		if (!ipc.PublishParameter(parameter, value, error)) {
+			LogWarning() << QString("ipc publish parameter fail, type: %1, error: %2\n").arg((qint32)type).arg((qint32)error);
+			return false;
+		}
+
+		return true;
+	}
+
+	return EventSetIntRequest::Send(ipc, type, value);
 }
 
 
@@ -317,37 +359,40 @@ bool EventSetStringRequest::Send(IPC &ipc, message::EventHead::Type type, const
 	// content 无需序列化
 
 	// 发送
-	return Request::Send(ipc, pBufferCommonHeader, pBufferEventHeader, content, nbytes);
+	return Request::SendEvent(ipc, type, pBufferCommonHeader, pBufferEventHeader, content, nbytes);
 }
 
 
 bool EventSetBrightnessFilterRequest::Send(IPC &ipc, int brightness)
 {
-	return EventSetIntRequest::Send(ipc, message::EventHead_Type_SetBrightnessFilter, brightness);
+	return EventSetIntRequest::SendLatest(ipc, message::EventHead_Type_SetBrightnessFilter, IPCParameterBlock::Brightness, brightness);
 }
 
 
 bool EventSetContrastFilterRequest::Send(IPC &ipc, int contrast)
 {
-	return EventSetIntRequest::Send(ipc, message::EventHead_Type_SetContrastFilter, contrast);
+	return EventSetIntRequest::SendLatest(ipc, message::EventHead_Type_SetContrastFilter, IPCParameterBlock::Contrast, contrast);
 }
 
 
 bool EventSetSaturationFilterRequest::Send(IPC &ipc, int saturation)
 {
-	return EventSetIntRequest::Send(ipc, message::EventHead_Type_SetSaturationFilter, saturation);
+	return EventSetIntRequest::SendLatest(ipc, message::EventHead_Type_SetSaturationFilter, IPCParameterBlock::Saturation, saturation);
 }
 
 
 bool EventSetGammaFilterrRequest::Send(IPC &ipc, int gamma)
 {
-	return EventSetIntRequest::Send(ipc, message::EventHead_Type_SetGammaFilter, gamma);
+	return EventSetIntRequest::SendLatest(ipc, message::EventHead_Type_SetGammaFilter, IPCParameterBlock::Gamma, gamma);
 }
 
 
 bool EventSetSpeedRequest::Send(IPC &ipc, int speed)
 {
-	return EventSetIntRequest::Send(ipc, message::EventHead_Type_SetSpeed, speed);
+	// 写入端按时间戳节流时，倍速同时作用于放行速度
+	ipc.SetPacingSpeed(speed);
+
+	return EventSetIntRequest::SendLatest(ipc, message::EventHead_Type_SetSpeed, IPCParameterBlock::Speed, speed);
 }
 
 
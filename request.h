@@ -4,15 +4,10 @@
 #include "ipc.h"
 #include "../proto/message.pb.h"
 
-// c/c++
-#include <mutex>
-
 
 class Request
 {
 public:
-    static std::mutex sMutex;
-
     // лint32
     static void Int32Serialization(int32_t size, char *bytes);
     // ֻйͷչͷûĵ
@@ -21,13 +16,19 @@ public:
     static bool Send(IPC &ipc, QByteArray &commonHeader, QByteArray &extendHeader, QByteArray &content);
     // ͺͷչͷֽ鼰Сĵ
     static bool Send(IPC &ipc, QByteArray &commonHeader, QByteArray &extendHeader, const char *content, int32_t nbytes);
+    // ѷֶεϢ鲼зֶһύ
+    static bool Send(IPC &ipc, const QVector<IPC::Buffer> &buffers);
+    // ¼Ϣпͨʱ߿ͨ
+    static bool SendEvent(IPC &ipc, message::EventHead::Type type, QByteArray &commonHeader, QByteArray &eventHeader, const char *content, int32_t nbytes);
+    // ¼ǷҪƵ֡Ⱥ˳
+    static bool IsOrderedEvent(message::EventHead::Type type);
 };
 
 
 class VideoRequest : public Request
 {
 public:
-    // Ƶ
+    // Ƶͨ˶֡ѹʱ֡Ҳtrue֡IPC::DroppedFrames
     static bool Send(
         IPC &ipc, char *content, uint32_t nbytes,
         enum message::VideoHead_FrameType type,
@@ -37,6 +38,14 @@ public:
 };
 
 
+class VideoConfigRequest : public Request
+{
+public:
+    // (SPS/PPS/VPS)òʱ°汾鲼ûпƿ飬ȡֻܵڵĲ
+    static bool Send(IPC &ipc, enum message::VideoHead_Codec codec, const char *extradata, int nbytes);
+};
+
+
 class EventSimpleRequest : public Request
 {
 public:
@@ -58,6 +67,8 @@ class EventSetIntRequest : public Request
 public:
     // ͺͷչͷϢͺintֵϢĵ¼ (eq ˾)
     static bool Send(IPC &ipc, message::EventHead::Type type, int value);
+    // ڵĲ(϶)вʱֵֻûʱ¼
+    static bool SendLatest(IPC &ipc, message::EventHead::Type type, IPCParameterBlock::Parameter parameter, int value);
 };
 
 
@@ -113,7 +124,7 @@ public:
 class EventTakeSnapshotRequest : public Request
 {
 public:
-    // ͼ
+    // ͼɶȡдpathָļҪֱõͼƬʱIPCRpcClient::TakeSnapshot
     static bool Send(IPC &ipc, const char *path, int nbytes);
 };
 
@@ -0,0 +1,181 @@
+// self
+#include "response.h"
+
+// project
+#include "../logger/logger.h"
+
+// c/c++
+#include <cstring>
+
+
+
+qint32 Response::Int32Deserialization(const char *bytes)
+{
+	qint32 size = 0;
+	std::memcpy(&size, bytes, sizeof(size));
+	return size;
+}
+
+
+bool Response::Receive(IPC &ipc, Response::Message &message, IPC::ReadError &error)
+{
+	// 邮箱里每条都是一条完整的最新消息，整条取出再解析
+	if (ipc.GetLayout() == IPC::Layout::Mailbox) {
+		QByteArray content;
+		quint64 stream = 0;
+		if (!ipc.ReadMessage(content, stream, error)) {
+			return false;
+		}
+
+		if (!Parse(content.constData(), content.size(), message)) {
+			LogWarningC("parse mailbox message fail\n");
+			error = IPC::ReadError::NoData;
+			return false;
+		}
+
+		message.control = false;
+		return true;
+	}
+
+	qint32 nbytesCommonHeader = -1;
+	while (true) {
+		// 控制通道优先，不用排在视频帧后面
+		QByteArray control;
+		if (ipc.ReadControl(control, error)) {
+			if (!Parse(control.constData(), control.size(), message)) {
+				LogWarningC("parse control message fail\n");
+				error = IPC::ReadError::NoData;
+				return false;
+			}
+
+			message.control = true;
+			return true;
+		}
+
+		// 读取数据通道时有控制消息到达，回到开头先处理控制消息
+		nbytesCommonHeader = ipc.ReadInt32(error);
+		if (error == IPC::ReadError::ControlPending) {
+			continue;
+		}
+
+		if (nbytesCommonHeader < 0) {
+			return false;
+		}
+
+		break;
+	}
+
+	QByteArray commonHeader;
+	if (!ipc.Read(commonHeader, nbytesCommonHeader, error)) {
+		return false;
+	}
+	message.commonHeader.Clear();
+	if (!message.commonHeader.ParseFromArray(commonHeader.constData(), commonHeader.size())) {
+		LogWarningC("parse common header fail\n");
+		return false;
+	}
+
+	message.extendHeader.clear();
+	message.content.clear();
+	message.control = false;
+
+	if (message.commonHeader.extend()) {
+		if (!ipc.Read(message.extendHeader, message.commonHeader.next_size(), error)) {
+			return false;
+		}
+	}
+
+	qint64 nbytesContent = ContentSize(message);
+	if (nbytesContent < 0) {
+		LogWarningC("parse extend header fail\n");
+		return false;
+	}
+
+	if (nbytesContent > 0 && !ipc.Read(message.content, nbytesContent, error)) {
+		return false;
+	}
+
+	return true;
+}
+
+
+bool Response::Parse(const char *buffer, qsizetype nbytes, Response::Message &message)
+{
+	qsizetype offset = sizeof(qint32);
+	if (nbytes < offset) {
+		return false;
+	}
+
+	qint32 nbytesCommonHeader = Int32Deserialization(buffer);
+	if (nbytesCommonHeader < 0 || nbytes - offset < nbytesCommonHeader) {
+		return false;
+	}
+
+	message.commonHeader.Clear();
+	if (!message.commonHeader.ParseFromArray(buffer + offset, nbytesCommonHeader)) {
+		return false;
+	}
+	offset += nbytesCommonHeader;
+
+	message.extendHeader.clear();
+	message.content.clear();
+
+	if (message.commonHeader.extend()) {
+		qsizetype nbytesExtendHeader = (qsizetype)message.commonHeader.next_size();
+		if (nbytes - offset < nbytesExtendHeader) {
+			return false;
+		}
+
+		message.extendHeader.append(buffer + offset, nbytesExtendHeader);
+		offset += nbytesExtendHeader;
+	}
+
+	qint64 nbytesContent = ContentSize(message);
+	if (nbytesContent < 0 || nbytes - offset < nbytesContent) {
+		return false;
+	}
+
+	message.content.append(buffer + offset, nbytesContent);
+
+	return true;
+}
+
+
+qint64 Response::ContentSize(const Response::Message &message)
+{
+	if (!message.commonHeader.extend()) {
+		return (qint64)message.commonHeader.next_size();
+	}
+
+	const char *pExtendHeader = message.extendHeader.constData();
+	qsizetype nbytesExtendHeader = message.extendHeader.size();
+
+	switch (message.commonHeader.type()) {
+	case message::CommonHead_Type_Audio:
+	{
+		message::AudioHead audioHeader;
+		if (!audioHeader.ParseFromArray(pExtendHeader, nbytesExtendHeader)) {
+			return -1;
+		}
+		return (qint64)audioHeader.next_size();
+	}
+	case message::CommonHead_Type_Video:
+	{
+		message::VideoHead videoHeader;
+		if (!videoHeader.ParseFromArray(pExtendHeader, nbytesExtendHeader)) {
+			return -1;
+		}
+		return (qint64)videoHeader.next_size();
+	}
+	case message::CommonHead_Type_Event:
+	{
+		message::EventHead eventHeader;
+		if (!eventHeader.ParseFromArray(pExtendHeader, nbytesExtendHeader)) {
+			return -1;
+		}
+		return (qint64)eventHeader.next_size();
+	}
+	default:
+		return -1;
+	}
+}
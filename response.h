@@ -0,0 +1,33 @@
+#pragma once
+
+// project
+#include "ipc.h"
+#include "../proto/message.pb.h"
+
+
+
+class Response
+{
+public:
+    // 一条完整的消息：消息头 + 扩展头 + 消息体
+    struct Message
+    {
+        // 基础消息头
+        message::CommonHead commonHeader;
+        // 扩展头，未反序列化，按commonHeader.type解析
+        QByteArray extendHeader;
+        // 消息体
+        QByteArray content;
+        // 是否来自控制通道
+        bool control;
+    };
+
+    // 反序列化int32
+    static qint32 Int32Deserialization(const char *bytes);
+    // 接收一条完整的消息，控制通道有消息时优先交付
+    static bool Receive(IPC &ipc, Response::Message &message, IPC::ReadError &error);
+    // 从一段连续内存解析一条完整的消息
+    static bool Parse(const char *buffer, qsizetype nbytes, Response::Message &message);
+    // 扩展头中描述的正文大小，没有扩展头时为基础消息头中的大小
+    static qint64 ContentSize(const Response::Message &message);
+};
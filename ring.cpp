@@ -0,0 +1,411 @@
+// self
+#include "ring.h"
+
+// c/c++
+#include <chrono>
+#include <new>
+
+
+
+static_assert(std::atomic<quint64>::is_always_lock_free, "shared memory ring requires lock free 64-bit atomics");
+static_assert((sizeof(IPCRing::Record) & (sizeof(IPCRing::Record) - 1)) == 0, "record header size must be a power of two");
+
+
+IPCRing::IPCRing()
+	: m_pHeader(nullptr)
+	, m_pData(nullptr)
+	, m_writeCursor(0)
+	, m_readCursor(0)
+	, m_writeRecords(0)
+	, m_readRecords(0)
+	, m_isHeld(false)
+	, m_isReadBoundary(true)
+{
+}
+
+
+qsizetype IPCRing::Bytes(qsizetype capacity)
+{
+	return sizeof(Header) + Align(capacity);
+}
+
+
+qsizetype IPCRing::Footprint(qsizetype size)
+{
+	return sizeof(Record) + Align(size);
+}
+
+
+void IPCRing::Format(void *address, qsizetype capacity)
+{
+	m_pHeader = new (address) Header();
+	m_pHeader->writeIndex.store(0, std::memory_order_relaxed);
+	m_pHeader->writeRecords.store(0, std::memory_order_relaxed);
+	m_pHeader->readIndex.store(0, std::memory_order_relaxed);
+	m_pHeader->readRecords.store(0, std::memory_order_relaxed);
+	m_pHeader->capacity = Align(capacity);
+	m_pData = (char *)address + sizeof(Header);
+
+	m_writeCursor = 0;
+	m_readCursor = 0;
+	m_writeRecords = 0;
+	m_readRecords = 0;
+	m_isHeld = false;
+	m_isReadBoundary = true;
+}
+
+
+void IPCRing::Attach(void *address)
+{
+	m_pHeader = (Header *)address;
+	m_pData = (char *)address + sizeof(Header);
+
+	m_writeCursor = m_pHeader->writeIndex.load(std::memory_order_acquire);
+	m_writeRecords = m_pHeader->writeRecords.load(std::memory_order_acquire);
+
+	// 上一个读取端在消息中间退出时占用标志仍在，从中间接着读
+	quint64 readIndex = m_pHeader->readIndex.load(std::memory_order_acquire);
+	m_readCursor = readIndex & ~Held;
+	m_readRecords = 0;
+	m_isHeld = (readIndex & Held) != 0;
+	m_isReadBoundary = !m_isHeld;
+}
+
+
+void IPCRing::Detach()
+{
+	m_pHeader = nullptr;
+	m_pData = nullptr;
+}
+
+
+bool IPCRing::IsAttached()
+{
+	return m_pHeader != nullptr;
+}
+
+
+char *IPCRing::Claim(qsizetype size, quint32 flags, qint64 deadline)
+{
+	quint64 capacity = m_pHeader->capacity;
+	quint64 need = Footprint(size);
+	if (need > capacity) {
+		return nullptr;
+	}
+
+	// 尾部放不下，需要额外占用尾部剩余空间做填充
+	quint64 tail = capacity - m_writeCursor % capacity;
+	quint64 total = tail < need ? tail + need : need;
+
+	quint64 used = m_writeCursor - (m_pHeader->readIndex.load(std::memory_order_acquire) & ~Held);
+	if (capacity - used < total) {
+		return nullptr;
+	}
+
+	if (tail < need) {
+		Record *pPadding = At(m_writeCursor);
+		pPadding->size = (quint32)(tail - sizeof(Record));
+		pPadding->flags = Padding;
+		pPadding->deadline = 0;
+		m_writeCursor += tail;
+	}
+
+	Record *pRecord = At(m_writeCursor);
+	pRecord->size = (quint32)size;
+	pRecord->flags = flags;
+	pRecord->deadline = deadline;
+	m_writeCursor += need;
+	m_writeRecords++;
+
+	return (char *)pRecord + sizeof(Record);
+}
+
+
+void IPCRing::Commit()
+{
+	m_pHeader->writeRecords.store(m_writeRecords, std::memory_order_relaxed);
+	m_pHeader->writeIndex.store(m_writeCursor, std::memory_order_release);
+}
+
+
+void IPCRing::Rollback()
+{
+	m_writeCursor = m_pHeader->writeIndex.load(std::memory_order_relaxed);
+	m_writeRecords = m_pHeader->writeRecords.load(std::memory_order_relaxed);
+}
+
+
+qsizetype IPCRing::Reclaim(qint64 now)
+{
+	// 读取端正在读一条消息，不能动
+	quint64 readIndex = m_pHeader->readIndex.load(std::memory_order_acquire);
+	if (readIndex & Held) {
+		return 0;
+	}
+
+	// 只回收已提交的消息，一条消息的所有记录一起提交、截止时间相同，按整条跳过
+	quint64 writeIndex = m_pHeader->writeIndex.load(std::memory_order_relaxed);
+	quint64 cursor = readIndex;
+	quint64 records = 0;
+	qsizetype messages = 0;
+	while (cursor < writeIndex) {
+		Record *pRecord = At(cursor);
+		if (pRecord->flags & Padding) {
+			cursor += sizeof(Record) + pRecord->size;
+			continue;
+		}
+
+		if (pRecord->deadline == 0 || pRecord->deadline > now) {
+			break;
+		}
+
+		while (cursor < writeIndex) {
+			pRecord = At(cursor);
+			if (pRecord->flags & Padding) {
+				cursor += sizeof(Record) + pRecord->size;
+				continue;
+			}
+
+			cursor += Footprint(pRecord->size);
+			records++;
+			if (pRecord->flags & MessageEnd) {
+				break;
+			}
+		}
+		messages++;
+	}
+
+	if (messages == 0) {
+		return 0;
+	}
+
+	// 读取端在此期间占用了读取位置，放弃回收
+	if (!m_pHeader->readIndex.compare_exchange_strong(readIndex, cursor, std::memory_order_acq_rel)) {
+		return 0;
+	}
+
+	m_pHeader->readRecords.fetch_add(records, std::memory_order_relaxed);
+
+	return messages;
+}
+
+
+const IPCRing::Record *IPCRing::Peek()
+{
+	quint64 writeIndex = m_pHeader->writeIndex.load(std::memory_order_acquire);
+
+	// 在消息边界先占住读取位置再读；写入端回收过过期消息时CAS失败，从写入端推进后的位置继续
+	while (!m_isHeld) {
+		if (m_readCursor == writeIndex) {
+			return nullptr;
+		}
+
+		quint64 readIndex = m_readCursor;
+		if (m_pHeader->readIndex.compare_exchange_strong(readIndex, m_readCursor | Held, std::memory_order_acq_rel)) {
+			m_isHeld = true;
+		}
+		else {
+			m_readCursor = readIndex & ~Held;
+		}
+	}
+
+	if (m_readCursor == writeIndex) {
+		return nullptr;
+	}
+
+	Record *pRecord = At(m_readCursor);
+	if (pRecord->flags & Padding) {
+		m_readCursor += sizeof(Record) + pRecord->size;
+		if (m_readCursor == writeIndex) {
+			return nullptr;
+		}
+
+		pRecord = At(m_readCursor);
+	}
+
+	return pRecord;
+}
+
+
+void IPCRing::Next()
+{
+	Record *pRecord = At(m_readCursor);
+	m_readCursor += Footprint(pRecord->size);
+	m_readRecords++;
+	m_isReadBoundary = (pRecord->flags & MessageEnd) != 0;
+}
+
+
+void IPCRing::Release()
+{
+	m_pHeader->readRecords.fetch_add(m_readRecords, std::memory_order_relaxed);
+	m_readRecords = 0;
+
+	// 停在消息中间时保留占用标志，写入端只从消息边界开始回收
+	if (m_isHeld) {
+		m_isHeld = !m_isReadBoundary;
+		m_pHeader->readIndex.store(m_isHeld ? m_readCursor | Held : m_readCursor, std::memory_order_release);
+	}
+}
+
+
+bool IPCRing::HasPending()
+{
+	quint64 writeIndex = m_pHeader->writeIndex.load(std::memory_order_acquire);
+
+	// 停在消息中间时剩下的记录不会被丢弃
+	if (m_isHeld) {
+		return m_isReadBoundary ? HasLive(m_readCursor, writeIndex) : m_readCursor != writeIndex;
+	}
+
+	// 未占用时写入端可能回收过期消息并覆盖扫描过的记录，读取位置变了就从新位置重新扫描
+	while (true) {
+		quint64 readIndex = m_pHeader->readIndex.load(std::memory_order_acquire);
+		bool pending = HasLive(qMax(m_readCursor, readIndex & ~Held), writeIndex);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (m_pHeader->readIndex.load(std::memory_order_relaxed) == readIndex) {
+			return pending;
+		}
+	}
+}
+
+
+void IPCRing::SkipAll()
+{
+	// 逐条跳过调用时已提交的记录，记录数与读取位置保持一致
+	quint64 writeIndex = m_pHeader->writeIndex.load(std::memory_order_acquire);
+	while (m_readCursor < writeIndex && Peek() != nullptr) {
+		Next();
+	}
+
+	Release();
+}
+
+
+qsizetype IPCRing::DiscardExpired()
+{
+	if (!m_isReadBoundary) {
+		return 0;
+	}
+
+	// 没有截止时间的记录不读时钟
+	qint64 now = 0;
+	qsizetype messages = 0;
+	const Record *pRecord = Peek();
+	while (pRecord != nullptr && pRecord->deadline != 0) {
+		if (now == 0) {
+			now = Now();
+		}
+
+		if (pRecord->deadline > now) {
+			break;
+		}
+
+		// 一条消息的所有记录一起提交，看到第一条就能跳到最后一条
+		do {
+			Next();
+		} while (!m_isReadBoundary && (pRecord = Peek()) != nullptr);
+		messages++;
+
+		pRecord = Peek();
+	}
+
+	return messages;
+}
+
+
+const char *IPCRing::Payload(const Record *pRecord)
+{
+	return (const char *)pRecord + sizeof(Record);
+}
+
+
+quint32 IPCRing::StreamFlags(quint64 stream)
+{
+	return (quint32)(stream & MaxStream) << StreamShift;
+}
+
+
+quint64 IPCRing::Stream(const Record *pRecord)
+{
+	return pRecord->flags >> StreamShift;
+}
+
+
+quint64 IPCRing::Committed()
+{
+	return m_pHeader->writeIndex.load(std::memory_order_acquire);
+}
+
+
+quint64 IPCRing::ReadCursor()
+{
+	return m_readCursor;
+}
+
+
+qsizetype IPCRing::Used()
+{
+	return m_pHeader->writeIndex.load(std::memory_order_acquire) - (m_pHeader->readIndex.load(std::memory_order_acquire) & ~Held);
+}
+
+
+qsizetype IPCRing::UsedRecords()
+{
+	return m_pHeader->writeRecords.load(std::memory_order_acquire) - m_pHeader->readRecords.load(std::memory_order_acquire);
+}
+
+
+qsizetype IPCRing::Capacity()
+{
+	return m_pHeader->capacity;
+}
+
+
+qint64 IPCRing::Now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+bool IPCRing::HasLive(quint64 cursor, quint64 writeIndex)
+{
+	// 一条消息的所有记录截止时间相同，逐条跳过过期记录即可；没有截止时间的记录不读时钟
+	qint64 now = 0;
+	while (cursor < writeIndex) {
+		const Record *pRecord = At(cursor);
+		if (pRecord->flags & Padding) {
+			cursor += sizeof(Record) + pRecord->size;
+			continue;
+		}
+
+		if (pRecord->deadline == 0) {
+			return true;
+		}
+
+		if (now == 0) {
+			now = Now();
+		}
+
+		if (pRecord->deadline > now) {
+			return true;
+		}
+
+		cursor += Footprint(pRecord->size);
+	}
+
+	return false;
+}
+
+
+qsizetype IPCRing::Align(qsizetype size)
+{
+	return (size + (qsizetype)sizeof(Record) - 1) & ~((qsizetype)sizeof(Record) - 1);
+}
+
+
+IPCRing::Record *IPCRing::At(quint64 index)
+{
+	return (Record *)(m_pData + index % m_pHeader->capacity);
+}
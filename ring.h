@@ -0,0 +1,152 @@
+#pragma once
+
+// qt
+#include <QtCore/QtGlobal>
+
+// c/c++
+#include <atomic>
+
+
+
+// 位于共享内存中的单写单读环形缓冲区，按记录读写
+// 记录 = 记录头 + 正文，按记录头大小对齐；尾部放不下时写入一条填充记录并回绕到起始位置
+// 容量和记录占用都是记录头大小的整数倍，尾部剩余空间总能放下填充记录的记录头
+// 读写位置只增不减，对容量取模得到偏移
+// 记录可以带截止时间：读取端在消息边界丢弃过期的整条消息，写入端空间不足时可以回收读取端尚未开始读的过期消息
+// 为此读取位置的最低位是占用标志，读取端读一条消息期间置位，写入端只在未置位时用CAS推进读取位置
+class IPCRing
+{
+public:
+    // 记录标志
+    enum Flag : quint32
+    {
+        // 填充记录，读取端直接跳过
+        Padding = 1u << 0,
+        // 一条消息的最后一条记录，一条消息的所有记录总是一起提交
+        MessageEnd = 1u << 1,
+        // 多条小消息合并成的一条记录，正文格式由IPC定义
+        Combined = 1u << 2,
+        // 写入端向新读取端重放GOP时的第一条消息，含义由IPC定义
+        GopStart = 1u << 3,
+    };
+
+    // 标志的高16位是流编号，多路复用时区分记录属于哪个逻辑流
+    static const quint32 StreamShift = 16;
+    static const quint64 MaxStream = 0xFFFF;
+    // 读取位置的占用标志，读取位置按记录头大小对齐，最低位空闲
+    static const quint64 Held = 1;
+
+    // 记录头
+    struct Record
+    {
+        // 正文大小
+        quint32 size;
+        // 标志
+        quint32 flags;
+        // 截止时间，单调时钟微秒数，见Now；0表示不过期。一条消息的所有记录相同
+        qint64 deadline;
+    };
+
+    // 环形缓冲区头部，读写位置各占一个缓存行，避免伪共享
+    struct Header
+    {
+        // 已提交的写入位置，只由写入端修改
+        alignas(64) std::atomic<quint64> writeIndex;
+        // 已提交的记录数(不含填充记录)，与writeIndex一起发布
+        std::atomic<quint64> writeRecords;
+        // 已释放的读取位置及占用标志，由读取端修改，写入端回收过期消息时用CAS推进
+        alignas(64) std::atomic<quint64> readIndex;
+        // 已释放的记录数(不含填充记录)，两端都只累加
+        std::atomic<quint64> readRecords;
+        // 数据区容量
+        alignas(64) quint64 capacity;
+    };
+
+
+public:
+    IPCRing();
+
+    // 容量为capacity时需要的共享内存字节数
+    static qsizetype Bytes(qsizetype capacity);
+    // 一条正文为size字节的记录实际占用的字节数
+    static qsizetype Footprint(qsizetype size);
+
+    // 写入端创建共享内存后初始化
+    void Format(void *address, qsizetype capacity);
+    // 读取端挂载共享内存后映射
+    void Attach(void *address);
+    // 解除映射
+    void Detach();
+    // 是否已映射
+    bool IsAttached();
+
+    // 写入端：申请一条记录，返回正文地址，空间不足返回nullptr；申请的记录在Commit之前对读取端不可见
+    char *Claim(qsizetype size, quint32 flags = 0, qint64 deadline = 0);
+    // 写入端：提交此前申请的全部记录
+    void Commit();
+    // 写入端：放弃此前申请但未提交的记录
+    void Rollback();
+    // 写入端：回收读取端尚未开始读的过期消息，返回回收的消息数；读取端正在读一条消息时不回收
+    qsizetype Reclaim(qint64 now);
+
+    // 读取端：取下一条已提交的记录，没有则返回nullptr；记录内容在Release之前保持有效
+    const Record *Peek();
+    // 读取端：跳过Peek到的记录
+    void Next();
+    // 读取端：释放此前跳过的全部记录，写入端可以复用这部分空间
+    void Release();
+    // 读取端：是否有尚未跳过、在消息边界也不会被DiscardExpired丢弃的已提交记录；不占用读取位置，为真时Peek一定能取到记录
+    bool HasPending();
+    // 读取端：跳过并释放全部已提交的记录
+    void SkipAll();
+    // 读取端：处于消息边界时跳过开头已过期的整条消息，返回跳过的消息数；不拷贝正文，跳过的记录随下一次Release释放
+    qsizetype DiscardExpired();
+
+    // 正文地址
+    static const char *Payload(const Record *pRecord);
+    // 流编号写入标志
+    static quint32 StreamFlags(quint64 stream);
+    // 记录所属的流编号
+    static quint64 Stream(const Record *pRecord);
+
+    // 写入端已提交的位置
+    quint64 Committed();
+    // 读取端本地的读取位置
+    quint64 ReadCursor();
+    // 已提交但未释放的字节数
+    qsizetype Used();
+    // 已提交但未释放的记录数
+    qsizetype UsedRecords();
+    // 容量
+    qsizetype Capacity();
+
+    // 单调时钟(微秒)，两个进程共用同一个系统时钟，截止时间按此计算
+    static qint64 Now();
+
+
+private:
+    // 按记录头大小向上对齐
+    static qsizetype Align(qsizetype size);
+    // 偏移处的记录头
+    Record *At(quint64 index);
+    // [cursor, writeIndex)之间是否有未过期的记录，跳过填充记录
+    bool HasLive(quint64 cursor, quint64 writeIndex);
+
+    // 共享内存中的头部
+    Header *m_pHeader;
+    // 共享内存中的数据区
+    char *m_pData;
+
+    // 写入端本地的写入位置，Commit时发布
+    quint64 m_writeCursor;
+    // 读取端本地的读取位置，Release时发布
+    quint64 m_readCursor;
+    // 写入端本地的记录数，随写入位置一起发布
+    quint64 m_writeRecords;
+    // 读取端跳过但尚未释放的记录数，Release时累加到共享的记录数
+    quint64 m_readRecords;
+    // 读取端是否已占用读取位置，占用期间写入端不回收
+    bool m_isHeld;
+    // 读取端是否处于消息边界，即上一条跳过的记录是消息的最后一条
+    bool m_isReadBoundary;
+};
@@ -0,0 +1,343 @@
+// self
+#include "rpc.h"
+
+// project
+#include "../logger/logger.h"
+#if defined(MPV_CLIENT)
+#include "../client/common.h"
+#else
+#include "../server/common.h"
+#endif
+
+// c/c++
+#include <chrono>
+#include <cstring>
+
+
+
+QString IPCRpc::RequestKey(const QString &key)
+{
+	return QString("%1_rpc_request").arg(key);
+}
+
+
+QString IPCRpc::ResponseKey(const QString &key)
+{
+	return QString("%1_rpc_response").arg(key);
+}
+
+
+IPCRpcClient::IPCRpcClient()
+	: m_isResponseAttached(false)
+	, m_NextId(0)
+	, m_isReading(false)
+{
+}
+
+
+IPCRpcClient::~IPCRpcClient()
+{
+	Stop();
+}
+
+
+bool IPCRpcClient::Start(const QString &key, qsizetype maxBytes)
+{
+	if (!m_Request.StartWriter(IPCRpc::RequestKey(key), IPCRpc::RequestMaxBytes, 0, IPC::Layout::Single)) {
+		LogWarning() << QString("start rpc request channel fail, key: %1\n").arg(key);
+		return false;
+	}
+
+	// 服务端还没开启时挂载失败，第一次调用时再等它上线
+	m_isResponseAttached = m_Response.StartReader(IPCRpc::ResponseKey(key), maxBytes, 0, IPC::Layout::Single);
+	if (m_isResponseAttached) {
+		m_Response.SetReaderAttachChar();
+	}
+
+	return true;
+}
+
+
+void IPCRpcClient::Stop()
+{
+	m_Request.Cancel();
+	m_Response.Cancel();
+
+	std::lock_guard<std::timed_mutex> locker(m_ReadMutex);
+	m_Request.StopWriter();
+	m_Response.StopReader();
+	m_isResponseAttached = false;
+
+	{
+		std::lock_guard<std::mutex> pendingLocker(m_PendingMutex);
+		m_Outstanding.clear();
+		m_Arrived.clear();
+	}
+	m_ArrivedCondition.notify_all();
+}
+
+
+bool IPCRpcClient::Invoke(quint32 method, const char *pData, qint64 nbytes, QByteArray &response, qint32 &status, qint32 msTimeout)
+{
+	QDeadlineTimer deadline(qMax(msTimeout, 0));
+	quint64 id = ++m_NextId;
+
+	// 先登记再发送，响应不会早于登记到达
+	{
+		std::lock_guard<std::mutex> locker(m_PendingMutex);
+		m_Outstanding.insert(id);
+	}
+
+	IPCRpc::Header header = { id, method, IPCRpc::Ok };
+	IPC::WriteError writeError;
+	if (!m_Request.Write({ { (const char *)&header, sizeof(header) }, { pData, nbytes } }, deadline, writeError)) {
+		LogWarning() << QString("rpc send fail, method: %1, error: %2\n").arg(method).arg((qint32)writeError);
+
+		std::lock_guard<std::mutex> locker(m_PendingMutex);
+		m_Outstanding.remove(id);
+		return false;
+	}
+
+	bool received = AwaitResponse(id, deadline, response, status);
+
+	// 超时的调用注销掉，之后到达的响应直接丢弃
+	std::lock_guard<std::mutex> locker(m_PendingMutex);
+	m_Outstanding.remove(id);
+	m_Arrived.remove(id);
+
+	return received;
+}
+
+
+bool IPCRpcClient::TakeSnapshot(const QByteArray &format, QByteArray &image, qint32 msTimeout)
+{
+	qint32 status = IPCRpc::Ok;
+	if (!Invoke(IPCRpc::Snapshot, format.constData(), format.size(), image, status, msTimeout)) {
+		return false;
+	}
+
+	if (status != IPCRpc::Ok) {
+		LogWarning() << QString("snapshot fail, status: %1\n").arg(status);
+		return false;
+	}
+
+	return true;
+}
+
+
+bool IPCRpcClient::AwaitResponse(quint64 id, const QDeadlineTimer &deadline, QByteArray &response, qint32 &status)
+{
+	std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + std::chrono::milliseconds(qMax<qint64>(deadline.remainingTime(), 0));
+
+	// 别的线程在读时不去抢读锁，否则要陪它等到它自己的截止时间；它读到本调用的响应会暂存并唤醒
+	{
+		std::unique_lock<std::mutex> locker(m_PendingMutex);
+		m_ArrivedCondition.wait_until(locker, until, [this, id]() { return m_Arrived.contains(id) || !m_isReading; });
+		if (m_isReading && !m_Arrived.contains(id)) {
+			return false;
+		}
+
+		if (!m_Arrived.contains(id)) {
+			m_isReading = true;
+		}
+	}
+
+	if (TakeArrived(id, response, status)) {
+		return true;
+	}
+
+	// Stop持有读锁时最多等到截止时间
+	bool received = false;
+	std::unique_lock<std::timed_mutex> reader(m_ReadMutex, std::defer_lock);
+	if (reader.try_lock_until(until)) {
+		received = WaitResponse(id, deadline, response, status);
+		reader.unlock();
+	}
+
+	// 让出读者身份，还在等的调用由其中一个接着读
+	{
+		std::lock_guard<std::mutex> locker(m_PendingMutex);
+		m_isReading = false;
+	}
+	m_ArrivedCondition.notify_all();
+
+	return received;
+}
+
+
+bool IPCRpcClient::WaitResponse(quint64 id, const QDeadlineTimer &deadline, QByteArray &response, qint32 &status)
+{
+	// 前一个持有读锁的调用可能已经替本次调用读到了响应
+	if (TakeArrived(id, response, status)) {
+		return true;
+	}
+
+	if (!m_isResponseAttached) {
+		m_isResponseAttached = m_Response.WaitUntilWriterAttached((qint32)deadline.remainingTime());
+		if (!m_isResponseAttached) {
+			LogWarningC("rpc server not attached\n");
+			return false;
+		}
+
+		m_Response.SetReaderAttachChar();
+	}
+
+	while (true) {
+		QByteArray content;
+		quint64 stream = 0;
+		IPC::ReadError error;
+		if (!m_Response.ReadMessage(content, stream, deadline, error)) {
+			if (error != IPC::ReadError::Timeout) {
+				LogWarning() << QString("rpc receive fail, error: %1\n").arg((qint32)error);
+			}
+
+			return false;
+		}
+
+		if (content.size() < (qsizetype)sizeof(IPCRpc::Header)) {
+			LogWarningC("rpc response truncated\n");
+			continue;
+		}
+
+		IPCRpc::Header header;
+		memcpy(&header, content.constData(), sizeof(header));
+		if (header.id == id) {
+			status = header.status;
+			response = content.mid(sizeof(header));
+			return true;
+		}
+
+		// 别的调用的响应暂存给它并唤醒，已经超时的调用的响应丢弃
+		{
+			std::lock_guard<std::mutex> locker(m_PendingMutex);
+			if (!m_Outstanding.contains(header.id)) {
+				continue;
+			}
+
+			m_Arrived.insert(header.id, qMakePair(header.status, content.mid(sizeof(header))));
+		}
+		m_ArrivedCondition.notify_all();
+	}
+}
+
+
+bool IPCRpcClient::TakeArrived(quint64 id, QByteArray &response, qint32 &status)
+{
+	std::lock_guard<std::mutex> locker(m_PendingMutex);
+	if (!m_Arrived.contains(id)) {
+		return false;
+	}
+
+	QPair<qint32, QByteArray> arrived = m_Arrived.take(id);
+	status = arrived.first;
+	response = arrived.second;
+
+	return true;
+}
+
+
+IPCRpcServer::IPCRpcServer()
+	: m_isRequestAttached(false)
+{
+}
+
+
+IPCRpcServer::~IPCRpcServer()
+{
+	Stop();
+}
+
+
+bool IPCRpcServer::Start(const QString &key, qsizetype maxBytes)
+{
+	if (!m_Response.StartWriter(IPCRpc::ResponseKey(key), maxBytes, 0, IPC::Layout::Single)) {
+		LogWarning() << QString("start rpc response channel fail, key: %1\n").arg(key);
+		return false;
+	}
+
+	// 客户端还没开启时挂载失败，接收时再等它上线
+	m_isRequestAttached = m_Request.StartReader(IPCRpc::RequestKey(key), IPCRpc::RequestMaxBytes, 0, IPC::Layout::Single);
+	if (m_isRequestAttached) {
+		m_Request.SetReaderAttachChar();
+	}
+
+	return true;
+}
+
+
+void IPCRpcServer::Stop()
+{
+	m_Request.Cancel();
+	m_Response.Cancel();
+
+	m_Request.StopReader();
+	m_Response.StopWriter();
+	m_isRequestAttached = false;
+}
+
+
+bool IPCRpcServer::Receive(IPCRpc::Call &call, QDeadlineTimer deadline, IPC::ReadError &error)
+{
+	if (!m_isRequestAttached) {
+		m_isRequestAttached = m_Request.WaitUntilWriterAttached((qint32)deadline.remainingTime());
+		if (!m_isRequestAttached) {
+			error = IPC::ReadError::Timeout;
+			return false;
+		}
+
+		m_Request.SetReaderAttachChar();
+	}
+
+	while (true) {
+		QByteArray content;
+		quint64 stream = 0;
+		if (!m_Request.ReadMessage(content, stream, deadline, error)) {
+			return false;
+		}
+
+		if (content.size() < (qsizetype)sizeof(IPCRpc::Header)) {
+			LogWarningC("rpc request truncated\n");
+			continue;
+		}
+
+		IPCRpc::Header header;
+		memcpy(&header, content.constData(), sizeof(header));
+		call.id = header.id;
+		call.method = header.method;
+		call.request = content.mid(sizeof(header));
+
+		return true;
+	}
+}
+
+
+bool IPCRpcServer::Reply(const IPCRpc::Call &call, qint32 status, const char *pData, qint64 nbytes, IPC::WriteError &error)
+{
+	IPCRpc::Header header = { call.id, call.method, status };
+
+	// 调用头和正文作为一条消息一次提交
+	std::lock_guard<std::mutex> locker(m_ReplyMutex);
+	if (!m_Response.Write({ { (const char *)&header, sizeof(header) }, { pData, nbytes } }, error)) {
+		LogWarning() << QString("rpc reply fail, method: %1, bytes: %2, error: %3\n").arg(call.method).arg(nbytes).arg((qint32)error);
+		return false;
+	}
+
+	return true;
+}
+
+
+bool IPCRpcServer::Serve(const Handler &handler, QDeadlineTimer deadline)
+{
+	IPCRpc::Call call;
+	IPC::ReadError readError;
+	if (!Receive(call, deadline, readError)) {
+		return false;
+	}
+
+	QByteArray response;
+	qint32 status = handler ? handler(call.method, call.request, response) : (qint32)IPCRpc::UnknownMethod;
+
+	IPC::WriteError writeError;
+
+	return Reply(call, status, response.constData(), response.size(), writeError);
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+// project
+#include "ipc.h"
+
+// qt
+#include <QtCore/QByteArray>
+#include <QtCore/QDeadlineTimer>
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+#include <QtCore/QSet>
+
+// c/c++
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+
+
+// 请求/响应：一对单块布局的通道，请求通道由客户端写、服务端读，响应通道方向相反
+// 每条消息 = 调用头 + 正文，响应带回请求的关联编号，客户端据此把响应交给对应的调用
+class IPCRpc
+{
+public:
+    // 方法
+    enum Method : quint32
+    {
+        // 截图，请求正文为图片格式(如"jpg")，响应正文为编码后的图片
+        Snapshot = 1,
+    };
+
+    // 响应状态，服务端自定义的错误用其它负数
+    enum Status : qint32
+    {
+        Ok = 0,
+        // 服务端不支持该方法
+        UnknownMethod = -1,
+        // 服务端处理失败
+        Failed = -2,
+    };
+
+    // 调用头
+    struct Header
+    {
+        // 关联编号，客户端分配，响应原样带回
+        quint64 id;
+        quint32 method;
+        qint32 status;
+    };
+
+    // 服务端收到的一次调用
+    struct Call
+    {
+        quint64 id;
+        quint32 method;
+        QByteArray request;
+    };
+
+    // 请求通道的消息上限，请求只带参数
+    static const qsizetype RequestMaxBytes = 64 * 1024;
+
+    // 由业务通道的键派生出请求/响应通道的键
+    static QString RequestKey(const QString &key);
+    static QString ResponseKey(const QString &key);
+};
+
+
+// 客户端：发起调用，等待对应的响应
+class IPCRpcClient
+{
+public:
+    IPCRpcClient();
+    ~IPCRpcClient();
+
+    // 开启请求通道的写入端和响应通道的读取端，maxBytes为最大响应大小；服务端可以晚于客户端开启
+    bool Start(const QString &key, qsizetype maxBytes = IPC::DefaultMaxBytes);
+    // 关闭两个通道，正在等待的调用返回失败
+    void Stop();
+
+    // 同步调用，可以在多个线程同时调用，每个调用只等到自己的超时；超时返回false，迟到的响应被丢弃
+    bool Invoke(quint32 method, const char *pData, qint64 nbytes, QByteArray &response, qint32 &status, qint32 msTimeout);
+    // 截图，编码后的图片经共享内存直接返回，不落盘
+    bool TakeSnapshot(const QByteArray &format, QByteArray &image, qint32 msTimeout);
+
+
+private:
+    // 等待id对应的响应：有线程在读时等它暂存，没有时自己读，都不超过deadline
+    bool AwaitResponse(quint64 id, const QDeadlineTimer &deadline, QByteArray &response, qint32 &status);
+    // 读响应直到取到id对应的一条，其它调用的响应暂存并唤醒等待者；调用方持有m_ReadMutex
+    bool WaitResponse(quint64 id, const QDeadlineTimer &deadline, QByteArray &response, qint32 &status);
+    // 取出暂存的响应
+    bool TakeArrived(quint64 id, QByteArray &response, qint32 &status);
+
+    IPC m_Request;
+    IPC m_Response;
+    // 响应通道的写入端是否已上线
+    bool m_isResponseAttached;
+
+    // 下一个关联编号
+    std::atomic<quint64> m_NextId;
+    // 同一时刻只有一个线程读响应通道
+    std::timed_mutex m_ReadMutex;
+    // 保护以下成员
+    std::mutex m_PendingMutex;
+    // 还在等待响应的调用
+    QSet<quint64> m_Outstanding;
+    // 已经读到但调用方还没取走的响应
+    QHash<quint64, QPair<qint32, QByteArray>> m_Arrived;
+    // 是否有线程正在读响应通道
+    bool m_isReading;
+    // 暂存了响应或读的线程退出时唤醒等待者
+    std::condition_variable m_ArrivedCondition;
+};
+
+
+// 服务端：取出调用，处理后回复；可以同步处理，也可以先取出调用，在别的线程处理完再回复
+class IPCRpcServer
+{
+public:
+    // 处理一次调用，返回状态，response为响应正文
+    using Handler = std::function<qint32(quint32 method, const QByteArray &request, QByteArray &response)>;
+
+    IPCRpcServer();
+    ~IPCRpcServer();
+
+    // 开启请求通道的读取端和响应通道的写入端，maxBytes为最大响应大小，须与客户端一致
+    bool Start(const QString &key, qsizetype maxBytes = IPC::DefaultMaxBytes);
+    // 关闭两个通道
+    void Stop();
+
+    // 取一次调用，最多等到deadline
+    bool Receive(IPCRpc::Call &call, QDeadlineTimer deadline, IPC::ReadError &error);
+    // 回复一次调用，正文直接写入响应通道的共享内存
+    bool Reply(const IPCRpc::Call &call, qint32 status, const char *pData, qint64 nbytes, IPC::WriteError &error);
+    // 取一次调用并交给handler处理，然后回复
+    bool Serve(const Handler &handler, QDeadlineTimer deadline);
+
+
+private:
+    IPC m_Request;
+    IPC m_Response;
+    // 请求通道的写入端是否已上线
+    bool m_isRequestAttached;
+    // 多个线程回复时保证一条响应的调用头和正文连续写入
+    std::mutex m_ReplyMutex;
+};
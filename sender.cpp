@@ -0,0 +1,216 @@
+// self
+#include "sender.h"
+
+// project
+#include "../logger/logger.h"
+
+
+
+IPCSender::Submission::Submission(SendFunction send, Completion completion)
+	: send(std::move(send))
+	, completion(std::move(completion))
+{
+}
+
+
+IPCSender::IPCSender(IPC &ipc, qsizetype capacity, IPCSender::Policy policy)
+	: m_ipc(ipc)
+	, m_Queue(capacity)
+	, m_Policy(policy)
+	, m_blockedWriters(0)
+	, m_isIdle(false)
+	, m_dropped(0)
+	, m_isRunning(false)
+	, m_activeSubmitters(0)
+{
+}
+
+
+IPCSender::~IPCSender()
+{
+	Stop();
+}
+
+
+void IPCSender::Start()
+{
+	if (m_isRunning.exchange(true)) {
+		return;
+	}
+
+	m_Thread = std::thread(&IPCSender::Run, this);
+}
+
+
+void IPCSender::Stop()
+{
+	if (!m_isRunning.exchange(false)) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> locker(m_Mutex);
+	}
+	m_Readable.notify_all();
+	m_Writable.notify_all();
+
+	// 发送线程可能阻塞在共享内存写入上，取消ipc打断等待
+	m_ipc.Cancel();
+	if (m_Thread.joinable()) {
+		m_Thread.join();
+	}
+
+	// 已看到运行中的提交线程可能还在入队，等它们结束后再清空，不会有提交漏掉完成回调
+	while (m_activeSubmitters.load() > 0) {
+		std::this_thread::yield();
+	}
+
+	IPCSender::Submission submission;
+	while (m_Queue.TryPop(submission)) {
+		Complete(submission, IPCSender::Status::Canceled);
+	}
+}
+
+
+void IPCSender::SetPolicy(IPCSender::Policy policy)
+{
+	m_Policy = policy;
+}
+
+
+IPCSender::Policy IPCSender::GetPolicy()
+{
+	return m_Policy;
+}
+
+
+bool IPCSender::Submit(IPCSender::Submission &&submission)
+{
+	// 先登记再检查运行状态，与Stop先置停止再等登记清零配对：要么Stop看到登记，要么这里看到已停止
+	m_activeSubmitters.fetch_add(1);
+	if (!m_isRunning.load()) {
+		m_activeSubmitters.fetch_sub(1);
+		Complete(submission, IPCSender::Status::Stopped);
+		return false;
+	}
+
+	bool status = Enqueue(submission);
+	m_activeSubmitters.fetch_sub(1);
+
+	return status;
+}
+
+
+bool IPCSender::Enqueue(IPCSender::Submission &submission)
+{
+	while (m_isRunning) {
+		if (m_Queue.TryPush(submission)) {
+			// 发送线程在休眠才需要唤醒，避免每条消息都进一次锁
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (m_isIdle.load()) {
+				{
+					std::lock_guard<std::mutex> locker(m_Mutex);
+				}
+				m_Readable.notify_one();
+			}
+
+			return true;
+		}
+
+		IPCSender::Policy policy = m_Policy;
+		if (policy == IPCSender::Policy::DropNewest) {
+			m_dropped++;
+			Complete(submission, IPCSender::Status::Dropped);
+			return false;
+		}
+
+		if (policy == IPCSender::Policy::DropOldest) {
+			// 从头部取出最早的一条丢弃，再重试放入
+			IPCSender::Submission oldest;
+			if (m_Queue.TryPop(oldest)) {
+				m_dropped++;
+				Complete(oldest, IPCSender::Status::Dropped);
+			}
+
+			continue;
+		}
+
+		// 先登记再检查一次，发送线程取走消息后看到登记就会唤醒
+		std::unique_lock<std::mutex> locker(m_Mutex);
+		m_blockedWriters++;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		m_Writable.wait(locker, [this]() { return !m_isRunning || m_Queue.Size() < m_Queue.Capacity(); });
+		m_blockedWriters--;
+	}
+
+	Complete(submission, IPCSender::Status::Canceled);
+
+	return false;
+}
+
+
+QFuture<IPCSender::Status> IPCSender::Submit(IPCSender::SendFunction send)
+{
+	QFutureInterface<IPCSender::Status> promise;
+	promise.reportStarted();
+
+	Submit(IPCSender::Submission(std::move(send), [promise](IPCSender::Status status) mutable {
+		promise.reportResult(status);
+		promise.reportFinished();
+	}));
+
+	return promise.future();
+}
+
+
+qsizetype IPCSender::Pending()
+{
+	return m_Queue.Size();
+}
+
+
+quint64 IPCSender::Dropped()
+{
+	return m_dropped.load();
+}
+
+
+void IPCSender::Run()
+{
+	IPCSender::Submission submission;
+	while (m_isRunning) {
+		if (!m_Queue.TryPop(submission)) {
+			std::unique_lock<std::mutex> locker(m_Mutex);
+			m_isIdle = true;
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			m_Readable.wait(locker, [this]() { return !m_isRunning || m_Queue.Size() > 0; });
+			m_isIdle = false;
+			continue;
+		}
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_blockedWriters.load() > 0) {
+			{
+				std::lock_guard<std::mutex> locker(m_Mutex);
+			}
+			m_Writable.notify_all();
+		}
+
+		bool status = submission.send && submission.send(m_ipc);
+		if (!status) {
+			LogWarningC("async send fail\n");
+		}
+
+		Complete(submission, status ? IPCSender::Status::Sent : IPCSender::Status::Failed);
+	}
+}
+
+
+void IPCSender::Complete(IPCSender::Submission &submission, IPCSender::Status status)
+{
+	if (submission.completion) {
+		submission.completion(status);
+	}
+
+	submission = IPCSender::Submission();
+}
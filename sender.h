@@ -0,0 +1,126 @@
+#pragma once
+
+// project
+#include "ipc.h"
+#include "queue.h"
+
+// qt
+#include <QtCore/QFuture>
+#include <QtCore/QFutureInterface>
+
+// c/c++
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+
+
+// 异步写入端，每个通道一个发送线程
+// 调用线程只把消息放进有界无锁队列，序列化和共享内存写入都在发送线程中完成，调用线程不会被读取端拖慢
+class IPCSender
+{
+public:
+    // 队列已满时的策略
+    enum class Policy
+    {
+        // 阻塞等待空位
+        Block,
+        // 丢弃新提交的消息
+        DropNewest,
+        // 丢弃队列中最早的消息，放入新消息
+        DropOldest,
+    };
+
+    // 发送结果
+    enum class Status
+    {
+        // 已写入共享内存
+        Sent,
+        // 因队列已满被丢弃
+        Dropped,
+        // 序列化或写入失败
+        Failed,
+        // 停止时仍在队列中，未发送
+        Canceled,
+        // 发送线程已停止，提交被拒绝
+        Stopped,
+    };
+
+    // 在发送线程中执行序列化和写入，返回是否成功，一般直接调用Request::Send系列
+    // std::function要求捕获的内容可拷贝，大块数据用QByteArray(隐式共享)或std::shared_ptr持有，入队时不会深拷贝
+    using SendFunction = std::function<bool(IPC &ipc)>;
+    // 完成回调，在发送线程(丢弃时在提交线程)中执行
+    using Completion = std::function<void(IPCSender::Status status)>;
+
+    // 一次提交，提交本身只移动不拷贝，消息内容由send的捕获持有
+    struct Submission
+    {
+        SendFunction send;
+        Completion completion;
+
+        Submission() = default;
+        Submission(SendFunction send, Completion completion = nullptr);
+        Submission(Submission &&other) = default;
+        Submission &operator=(Submission &&other) = default;
+        Submission(const Submission &) = delete;
+        Submission &operator=(const Submission &) = delete;
+    };
+
+    static const qsizetype DefaultCapacity = 64;
+
+    // ipc须已开启写入端，capacity会向上取到2的幂
+    explicit IPCSender(IPC &ipc, qsizetype capacity = DefaultCapacity, IPCSender::Policy policy = IPCSender::Policy::Block);
+    ~IPCSender();
+
+    // 启动发送线程
+    void Start();
+    // 停止发送线程，队列中未发送的消息以Canceled完成，之后的提交以Stopped完成
+    // 发送线程可能阻塞在共享内存写入上，停止时会取消ipc，ipc须重新开启写入端才能继续使用
+    void Stop();
+
+    // 队列已满时的策略
+    void SetPolicy(IPCSender::Policy policy);
+    IPCSender::Policy GetPolicy();
+
+    // 提交，结果通过回调返回；返回false表示未入队，此时回调已以Dropped、Canceled或Stopped执行
+    bool Submit(IPCSender::Submission &&submission);
+    // 提交，结果通过QFuture返回
+    QFuture<IPCSender::Status> Submit(IPCSender::SendFunction send);
+
+    // 队列中的消息数
+    qsizetype Pending();
+    // 累计丢弃的消息数
+    quint64 Dropped();
+
+
+private:
+    // 发送线程
+    void Run();
+    // 入队，按队列已满时的策略处理
+    bool Enqueue(IPCSender::Submission &submission);
+    // 以给定结果完成一次提交
+    static void Complete(IPCSender::Submission &submission, IPCSender::Status status);
+
+    IPC &m_ipc;
+    IPCBoundedQueue<IPCSender::Submission> m_Queue;
+    std::atomic<IPCSender::Policy> m_Policy;
+
+    // 仅用于休眠和唤醒，队列本身无锁
+    std::mutex m_Mutex;
+    // 队列非空
+    std::condition_variable m_Readable;
+    // 队列有空位
+    std::condition_variable m_Writable;
+    // 正在等待空位的提交线程数
+    std::atomic<qint32> m_blockedWriters;
+    // 发送线程是否在休眠
+    std::atomic<bool> m_isIdle;
+
+    std::atomic<quint64> m_dropped;
+    std::atomic<bool> m_isRunning;
+    // 已通过运行检查、尚未入队完成的提交线程数，停止时等它们入队后再清空队列
+    std::atomic<qint32> m_activeSubmitters;
+    std::thread m_Thread;
+};
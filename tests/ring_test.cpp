@@ -0,0 +1,347 @@
+// IPCRing 单独测试：回绕、填充、占用标志与过期回收
+// 不依赖共享内存，写入端和读取端映射同一块进程内存
+// 构建: g++ -std=c++20 -I.. -I<Qt>/include -I<Qt>/include/QtCore ring_test.cpp ../ring.cpp -o ring_test -lpthread
+
+// project
+#include "ring.h"
+
+// c/c++
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+
+
+
+// 不受NDEBUG影响的检查
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			std::exit(1); \
+		} \
+	} while (0)
+
+
+// 足够放下测试用的最大环形缓冲区
+alignas(64) static char g_Memory[1 << 16];
+
+
+// 写入端格式化、读取端挂载同一块内存
+static void Open(IPCRing &writer, IPCRing &reader, qsizetype capacity)
+{
+	CHECK(IPCRing::Bytes(capacity) <= (qsizetype)sizeof(g_Memory));
+	std::memset(g_Memory, 0xCD, sizeof(g_Memory));
+	writer.Format(g_Memory, capacity);
+	reader.Attach(g_Memory);
+}
+
+
+// 写入一条单记录消息，正文填满value
+static bool Write(IPCRing &writer, qsizetype size, char value, qint64 deadline = 0)
+{
+	char *pPayload = writer.Claim(size, IPCRing::MessageEnd, deadline);
+	if (pPayload == nullptr) {
+		return false;
+	}
+
+	std::memset(pPayload, value, size);
+	writer.Commit();
+
+	return true;
+}
+
+
+// 读取一条单记录消息并检查正文
+static void Expect(IPCRing &reader, qsizetype size, char value)
+{
+	const IPCRing::Record *pRecord = reader.Peek();
+	CHECK(pRecord != nullptr);
+	CHECK(pRecord->size == (quint32)size);
+	CHECK((pRecord->flags & IPCRing::Padding) == 0);
+
+	const char *pPayload = IPCRing::Payload(pRecord);
+	for (qsizetype i = 0; i < size; i++) {
+		CHECK(pPayload[i] == value);
+	}
+
+	reader.Next();
+	reader.Release();
+}
+
+
+// 尾部只剩一个记录头大小时写入填充记录回绕，读取端跳过填充
+static void TestWrapPadding()
+{
+	IPCRing writer;
+	IPCRing reader;
+	Open(writer, reader, 256);
+	CHECK(writer.Capacity() == 256);
+
+	// 占到偏移240，尾部剩16字节，只够放填充记录的记录头
+	qsizetype size = 256 - 2 * sizeof(IPCRing::Record);
+	CHECK(IPCRing::Footprint(size) == 240);
+	CHECK(Write(writer, size, 'a'));
+	Expect(reader, size, 'a');
+	CHECK(writer.Committed() == 240);
+
+	// 需要32字节，填充16字节后从偏移0开始
+	CHECK(Write(writer, 8, 'b'));
+	CHECK(writer.Committed() == 256 + 32);
+	CHECK(writer.UsedRecords() == 1);
+	CHECK(reader.HasPending());
+	Expect(reader, 8, 'b');
+	CHECK(!reader.HasPending());
+	CHECK(writer.Used() == 0);
+	CHECK(writer.UsedRecords() == 0);
+	CHECK(reader.ReadCursor() == 256 + 32);
+}
+
+
+// 尾部刚好放得下时不填充
+static void TestExactFit()
+{
+	IPCRing writer;
+	IPCRing reader;
+	Open(writer, reader, 256);
+
+	CHECK(Write(writer, 128 - sizeof(IPCRing::Record), 'a'));
+	Expect(reader, 128 - sizeof(IPCRing::Record), 'a');
+	CHECK(Write(writer, 128 - sizeof(IPCRing::Record), 'b'));
+	CHECK(writer.Committed() == 256);
+	Expect(reader, 128 - sizeof(IPCRing::Record), 'b');
+	CHECK(reader.ReadCursor() == 256);
+}
+
+
+// 空间不足时申请失败，填充占用的尾部也要计入
+static void TestFull()
+{
+	IPCRing writer;
+	IPCRing reader;
+	Open(writer, reader, 256);
+
+	// 超过容量的记录永远放不下
+	CHECK(writer.Claim(256, IPCRing::MessageEnd) == nullptr);
+
+	CHECK(Write(writer, 160 - sizeof(IPCRing::Record), 'a'));
+	CHECK(Write(writer, 48 - sizeof(IPCRing::Record), 'b'));
+	Expect(reader, 160 - sizeof(IPCRing::Record), 'a');
+
+	// 写入位置208，尾部48，空闲208；需要64字节，加上填充共112字节
+	CHECK(Write(writer, 64 - sizeof(IPCRing::Record), 'c'));
+	CHECK(writer.Committed() == 256 + 64);
+
+	// 空闲160，需要176字节，放不下；未提交的申请可以放弃
+	CHECK(writer.Claim(176 - sizeof(IPCRing::Record), IPCRing::MessageEnd) == nullptr);
+	CHECK(writer.Claim(8, IPCRing::MessageEnd) != nullptr);
+	writer.Rollback();
+	CHECK(writer.Committed() == 256 + 64);
+
+	Expect(reader, 48 - sizeof(IPCRing::Record), 'b');
+	Expect(reader, 64 - sizeof(IPCRing::Record), 'c');
+	CHECK(!reader.HasPending());
+	CHECK(writer.Used() == 0);
+}
+
+
+// 读取端占用期间写入端不回收，在消息边界释放后才能回收
+static void TestReclaim()
+{
+	IPCRing writer;
+	IPCRing reader;
+	Open(writer, reader, 1024);
+
+	// 一条两记录的过期消息
+	CHECK(writer.Claim(8, 0, 1) != nullptr);
+	CHECK(writer.Claim(8, IPCRing::MessageEnd, 1) != nullptr);
+	writer.Commit();
+
+	// 读取端读到消息中间，释放后仍然占用
+	CHECK(reader.Peek() != nullptr);
+	CHECK(writer.Reclaim(100) == 0);
+	reader.Next();
+	reader.Release();
+	CHECK(writer.Reclaim(100) == 0);
+	CHECK(writer.UsedRecords() == 1);
+
+	// 读完整条消息后释放占用
+	CHECK(reader.Peek() != nullptr);
+	reader.Next();
+	reader.Release();
+	CHECK(writer.Used() == 0);
+
+	// 两条过期消息后跟一条未过期的，只回收前两条
+	CHECK(Write(writer, 8, 'a', 1));
+	CHECK(writer.Claim(8, 0, 2) != nullptr);
+	CHECK(writer.Claim(8, IPCRing::MessageEnd, 2) != nullptr);
+	writer.Commit();
+	CHECK(Write(writer, 8, 'b', 1000));
+	CHECK(Write(writer, 8, 'c'));
+	CHECK(writer.Reclaim(100) == 2);
+	CHECK(writer.UsedRecords() == 2);
+
+	// 读取端从写入端推进后的位置继续
+	CHECK(reader.HasPending());
+	Expect(reader, 8, 'b');
+	Expect(reader, 8, 'c');
+	CHECK(!reader.HasPending());
+	CHECK(writer.Used() == 0);
+	CHECK(writer.UsedRecords() == 0);
+
+	// 没有截止时间的消息不回收
+	CHECK(Write(writer, 8, 'd'));
+	CHECK(writer.Reclaim(100) == 0);
+	Expect(reader, 8, 'd');
+}
+
+
+// 回收跨过回绕位置的填充记录
+static void TestReclaimWrap()
+{
+	IPCRing writer;
+	IPCRing reader;
+	Open(writer, reader, 256);
+
+	CHECK(Write(writer, 256 - 2 * sizeof(IPCRing::Record), 'a'));
+	Expect(reader, 256 - 2 * sizeof(IPCRing::Record), 'a');
+
+	// 过期消息前有一条填充记录
+	CHECK(Write(writer, 8, 'b', 1));
+	CHECK(Write(writer, 8, 'c'));
+	CHECK(writer.Reclaim(100) == 1);
+	CHECK(writer.UsedRecords() == 1);
+	Expect(reader, 8, 'c');
+	CHECK(writer.Used() == 0);
+}
+
+
+// HasPending只是探测，不占用读取位置，不妨碍写入端回收；已过期的消息不算
+static void TestHasPending()
+{
+	IPCRing writer;
+	IPCRing reader;
+	Open(writer, reader, 1024);
+
+	qint64 future = IPCRing::Now() + 60 * 1000 * 1000;
+	CHECK(!reader.HasPending());
+	CHECK(Write(writer, 8, 'a', future));
+	CHECK(reader.HasPending());
+	CHECK(writer.Reclaim(future) == 1);
+	CHECK(!reader.HasPending());
+	CHECK(reader.Peek() == nullptr);
+
+	// 只剩过期消息时读取不会阻塞在Peek之后
+	CHECK(writer.Claim(8, 0, 1) != nullptr);
+	CHECK(writer.Claim(8, IPCRing::MessageEnd, 1) != nullptr);
+	writer.Commit();
+	CHECK(!reader.HasPending());
+	CHECK(Write(writer, 8, 'b'));
+	CHECK(reader.HasPending());
+	CHECK(reader.DiscardExpired() == 1);
+	Expect(reader, 8, 'b');
+	CHECK(!reader.HasPending());
+	CHECK(writer.Used() == 0);
+}
+
+
+// 读取端在消息边界丢弃过期的整条消息
+static void TestDiscardExpired()
+{
+	IPCRing writer;
+	IPCRing reader;
+	Open(writer, reader, 1024);
+
+	qint64 future = IPCRing::Now() + 60 * 1000 * 1000;
+	CHECK(writer.Claim(8, 0, 1) != nullptr);
+	CHECK(writer.Claim(8, IPCRing::MessageEnd, 1) != nullptr);
+	writer.Commit();
+	CHECK(Write(writer, 8, 'a', 1));
+	CHECK(Write(writer, 8, 'b', future));
+	CHECK(Write(writer, 8, 'c', 1));
+
+	CHECK(reader.DiscardExpired() == 2);
+	Expect(reader, 8, 'b');
+	CHECK(writer.UsedRecords() == 1);
+
+	// 停在消息中间时不丢弃
+	CHECK(writer.Claim(8, 0, future) != nullptr);
+	CHECK(writer.Claim(8, IPCRing::MessageEnd, 1) != nullptr);
+	writer.Commit();
+	CHECK(reader.DiscardExpired() == 1);
+	CHECK(reader.Peek() != nullptr);
+	reader.Next();
+	CHECK(reader.DiscardExpired() == 0);
+	reader.Next();
+	reader.Release();
+	CHECK(!reader.HasPending());
+	CHECK(writer.Used() == 0);
+	CHECK(writer.UsedRecords() == 0);
+}
+
+
+// 两个线程随机长度读写多圈，检查顺序和正文
+static void TestConcurrent()
+{
+	IPCRing writer;
+	IPCRing reader;
+	Open(writer, reader, 4096);
+
+	const quint32 count = 200000;
+	std::thread producer([&writer, count]() {
+		std::mt19937 random(1);
+		for (quint32 i = 0; i < count; i++) {
+			qsizetype size = sizeof(quint32) + random() % 300;
+			char *pPayload = nullptr;
+			while ((pPayload = writer.Claim(size, IPCRing::MessageEnd)) == nullptr) {
+				std::this_thread::yield();
+			}
+
+			std::memset(pPayload, (char)i, size);
+			std::memcpy(pPayload, &i, sizeof(i));
+			writer.Commit();
+		}
+	});
+
+	std::mt19937 random(1);
+	for (quint32 i = 0; i < count; i++) {
+		qsizetype size = sizeof(quint32) + random() % 300;
+		const IPCRing::Record *pRecord = nullptr;
+		while ((pRecord = reader.Peek()) == nullptr) {
+			std::this_thread::yield();
+		}
+
+		CHECK(pRecord->size == (quint32)size);
+		const char *pPayload = IPCRing::Payload(pRecord);
+		quint32 sequence = 0;
+		std::memcpy(&sequence, pPayload, sizeof(sequence));
+		CHECK(sequence == i);
+		CHECK(pPayload[size - 1] == (char)i || size == sizeof(quint32));
+
+		reader.Next();
+		reader.Release();
+	}
+
+	producer.join();
+	CHECK(!reader.HasPending());
+	CHECK(writer.Used() == 0);
+	CHECK(writer.UsedRecords() == 0);
+}
+
+
+int main()
+{
+	TestWrapPadding();
+	TestExactFit();
+	TestFull();
+	TestReclaim();
+	TestReclaimWrap();
+	TestHasPending();
+	TestDiscardExpired();
+	TestConcurrent();
+
+	std::printf("ring_test passed\n");
+
+	return 0;
+}